@@ -37,48 +37,80 @@
   SUCH DAMAGE.
 
 */
-#include <avr/pgmspace.h>
-#include <avr/interrupt.h>
+#include <string.h>
+#include "eeprom_hal.h"
 #include "eeprom.h"
+#if EEPROM_USE_LOG
+#include "eeprom_log.h"
+#endif
 
+// Структура записи в буфере. Элемент кольцевого буфера и статус определяются в момент записи в EEPROM
 typedef struct {
-	uint8_t element_size;  // Размер данных (без учета счетчика)
-	uint8_t buffer_count;  // Количество элементов в буфере
-	uint16_t addr;         // Начальный адрес в EEPROM
-} param_eeprom_t;
-
+	uint8_t index;		// Индекс параметра
+	uint8_t offset;		// Смещение копии данных в арене банка
+} buffer_record_t;
 
-// Структура записи в буфере
+// Банк буфера записи: данные копируются в арену в момент добавления
 typedef struct {
-	uint16_t adr_eeprom;	// Адрес EEPROM куда записываем данные
-	uint8_t newStatus;	// новый статус записи
-	const uint8_t *data_ptr; // Указатель на данные
-	uint8_t data_size;	// Размер данных
-} buffer_record_t;
+	buffer_record_t record[MAX_WRITE_BUFFER_SIZE];
+	uint8_t data[EEPROM_WRITE_ARENA_SIZE];
+	uint8_t count;		// Количество записей
+	uint8_t used;		// Занято байт арены
+#if EEPROM_USE_TXN
+	uint8_t group;		// Записи транзакции [group, group_end), group_end == 0 - группы нет
+	uint8_t group_end;
+#endif
+} write_bank_t;
 
-volatile buffer_record_t eeprom_writebuffer[MAX_WRITE_BUFFER_SIZE];
-volatile uint8_t eeprom_writebuffer_head = 0;
-volatile uint8_t eeprom_writebuffer_tail = 0;
+// Двойная буферизация: пока один банк записывается в EEPROM, новые записи добавляются в другой
+static volatile write_bank_t eeprom_bank[2];
+// Банк, в который добавляются записи (записывается банк eeprom_fill_bank ^ 1)
+static volatile uint8_t eeprom_fill_bank = 0;
 // Флаг, указывающий, что запись EEPROM в процессе
-volatile uint8_t eeprom_busy_flag = 0;
+static volatile uint8_t eeprom_busy_flag = 0;
+// StartWriteBuffer() вызван во время записи: после нее сразу записать заполняемый банк
+static volatile uint8_t eeprom_flush_request = 0;
 // Статическая переменная для отслеживания позиции в текущем блоке записи
-// Значение 0 означает, что для нового блока еще не был записан newStatus.
-// После записи newStatus current_byte_index становится 1.
+// Значение 0 означает, что запись нового блока еще не начата. Без EEPROM_USE_CRC первым
+// записывается newStatus (current_byte_index становится равным seq_size), с CRC - последним.
 static volatile uint8_t current_byte_index = 0;
+// Номер записываемой записи в банке eeprom_fill_bank ^ 1
+static uint8_t record_pos = 0;
 
 /* ************************************ скрипт на питоне генерирует код для переменных  ******************************
 
+# В приложении на C++ вместо скрипта можно описать параметры типами в eeprom.hpp: адреса и проверка
+# переполнения вычисляются при компиляции, таблица задается EEPROM_DEFINE_LAYOUT() (см. EEPROM_PARAM_COUNT)
+
 # Размер EEPROM
 EEPROM_SIZE = 4000
 EEPROM_START_ADR = 100  # Начальный адрес
+# Во внешней EEPROM со страничной записью (-DEEPROM_HAL_PAGE_SIZE) буферы выравниваются по страницам
+# макросами EEPROM_PAGE_ALIGN и EEPROM_RING_BYTES: элемент не пересекает границу страницы
 
-# Таблица данных (name_param, тип, количество элементов)
+# Таблица данных (name_param, тип, количество элементов, [размер счетчика 1 или 2 байта])
+# Для кольцевых буферов длиннее 255 элементов нужен 2-байтовый счетчик, он выбирается автоматически
 params = [
 {"name_param": "EE_LCD_LIGHT", "type": "uint8_t", "count": 5},
 {"name_param": "EE_BAT_MIN_V", "type": "uint16_t", "count": 100},
+# {"name_param": "EE_MOTOR_POS", "type": "uint16_t", "count": 1000, "seq": 2},
+# Счетчик (EEPROM_USE_COUNTER): тип uint32_t, "counter" - размер области приращений в байтах (8 приращений на байт)
+# {"name_param": "EE_MOTOR_HOURS", "type": "uint32_t", "count": 4, "counter": 16},
+# Для кэша в ОЗУ (EEPROM_USE_SHADOW) можно указать затишье в тиках EEPROM_Tick(): "quiet": 10
+# Для аварийной записи (EEPROM_USE_EMERGENCY) - приоритет, больше - важнее: "priority": 1
+# Для журнала (EEPROM_USE_LOG) count не используется: все параметры пишутся в общую область до EEPROM_SIZE
 # Добавьте дополнительные параметры по необходимости
 ]
 
+for param in params:
+	param.setdefault("seq", 1 if param["count"] < 256 else 2)
+	param.setdefault("quiet", 10)
+	param.setdefault("counter", 0)
+	param.setdefault("priority", 0)
+	assert param["seq"] in (1, 2), f"{param['name_param']}: счетчик может быть только 1 или 2 байта"
+	assert param["count"] < (1 << (8 * param["seq"])), f"{param['name_param']}: слишком много элементов для {param['seq']}-байтового счетчика"
+	assert param["counter"] == 0 or (param["type"] == "uint32_t" and param["counter"] <= 248), f"{param['name_param']}: счетчик - uint32_t, область приращений до 248 байт"
+
 # Вывод описания блоков параметров
 print("// Наименование используемых параметров. Необходимо перенести в .h файл")
 print("enum {")
@@ -96,28 +128,37 @@ print(f"\tEEPROM_START_ADR = {EEPROM_START_ADR},")
 for i, param in enumerate(params):
 	# Генерируем код для каждого блока
 	print(f"\n\t{param['name_param']}_SIZE = sizeof({param['type']}),")
+	print(f"\t{param['name_param']}_SEQ = {param['seq']},")
 	print(f"\t{param['name_param']}_COUNT = {param['count']},")
+	print(f"\t{param['name_param']}_QUIET = {param['quiet']},")
+	print(f"\t{param['name_param']}_COUNTER = {param['counter']},")
+	print(f"\t{param['name_param']}_PRIORITY = {param['priority']},")
 	
 	# Проверяем, если i > 0, используем адрес конца предыдущего блока, иначе начальный адрес
 	if i > 0:
-		print(f"\t{param['name_param']}_ADDR = {params[i-1]['name_param']}_END,")
+		print(f"\t{param['name_param']}_ADDR = EEPROM_PAGE_ALIGN({params[i-1]['name_param']}_END),")
 	else:
-		print(f"\t{param['name_param']}_ADDR = EEPROM_START_ADR,")
+		print(f"\t{param['name_param']}_ADDR = EEPROM_PAGE_ALIGN(EEPROM_START_ADR),")
 	
 	# Формула для расчёта конца блока
-	print(f"\t{param['name_param']}_END = {param['name_param']}_ADDR + ({param['name_param']}_SIZE + 1) * {param['name_param']}_COUNT,")  # Плюс 1 для учета кольцевого буфера
+	print(f"\t{param['name_param']}_END = {param['name_param']}_ADDR + EEPROM_RING_BYTES({param['name_param']}_SIZE + {param['name_param']}_SEQ + EEPROM_CRC_SIZE, {param['name_param']}_COUNT) + 2 * {param['name_param']}_COUNTER,")  # Плюс счетчик и CRC для учета кольцевого буфера, две области приращений счетчика
+
+# Суммарный размер данных всех параметров (для кэша в ОЗУ)
+print(f"\n\tEEPROM_DATA_SIZE = {' + '.join(param['name_param'] + '_SIZE' for param in params)},")
 
 	# Выводим проверку переполнения EEPROM
 print("\n};")
 print("\n// Проверяем выход за границы EEPROM (если здесь компилятор выдает ошибку значит блоки переменных не помещаются в EEPROM)")
 print("// !!!!!!!!!!!!!!            Не забываем указать индекс последней переменной          !!!!!!!!!!!!!!!!!!!!!!")
 print(f"extern uint8_t error_eeprom_overflow[{params[-1]['name_param']}_END > EEPROM_SIZE ? -1 : 0];")
+print("\n// Значение параметра должно помещаться в запись журнала (если здесь компилятор выдает ошибку - увеличьте EEPROM_LOG_VALUE_SIZE)")
+print(f"extern uint8_t error_eeprom_log_value[(EEPROM_USE_LOG && ({' || '.join(param['name_param'] + '_SIZE > EEPROM_LOG_VALUE_SIZE' for param in params)})) ? -1 : 0];")
 
 # Печатаем описание блока данных
 print("\nconst param_eeprom_t param_eeprom[] PROGMEM = {")
 for i, param in enumerate(params):
 	# Добавляем комментарий с индексом и наименованием параметра
-	print(f"\t{{{param['name_param']}_SIZE, {param['name_param']}_COUNT, {param['name_param']}_ADDR}},  //  Индекс {i}, {param['name_param']}, тип {param['type']}, \tколичество элементов {param['count']}")
+	print(f"\t{{{param['name_param']}_SIZE, {param['name_param']}_SEQ, {param['name_param']}_COUNT, {param['name_param']}_ADDR, {param['name_param']}_QUIET, {param['name_param']}_COUNTER, {param['name_param']}_PRIORITY}},  //  Индекс {i}, {param['name_param']}, тип {param['type']}, \tколичество элементов {param['count']}")
 print("};")
 
 
@@ -127,6 +168,21 @@ print("};")
 /*                                                                  Код полученный из питона                                                                      */
 /******************************************************************************************************************************************************************/
 
+#if defined(EEPROM_PARAM_COUNT)
+// Таблица параметров задана в приложении на C++ (EEPROM_DEFINE_LAYOUT() из eeprom.hpp).
+// Размер и начальный адрес EEPROM хранятся в ней же, их проверки выполняет eeprom.hpp
+extern const eeprom_layout_t eeprom_layout PROGMEM;
+#define param_eeprom     (eeprom_layout.param)
+#define EEPROM_SIZE      pgm_read_word(&eeprom_layout.size)
+#define EEPROM_START_ADR pgm_read_word(&eeprom_layout.start)
+#if (EEPROM_USE_SHADOW || EEPROM_USE_READ_CACHE) && !defined(EEPROM_DATA_SIZE)
+#error "EEPROM_USE_SHADOW, EEPROM_USE_READ_CACHE: задайте EEPROM_DATA_SIZE (суммарный размер параметров) вместе с EEPROM_PARAM_COUNT"
+#endif
+#elif defined(EEPROM_LAYOUT_FILE)
+// Таблица параметров из отдельного файла (например, сборка на хосте с другими размерами буферов)
+#include EEPROM_LAYOUT_FILE
+#else
+
 
 
 // Необходимо заполнить и при необходимости добавить следующую структуру, так же для заполнения таблицы можно воспользоваться скриптом питона
@@ -135,14 +191,24 @@ enum {
 	EEPROM_START_ADR = 100,
 
 	EE_LCD_LIGHT_SIZE = sizeof(uint8_t),
+	EE_LCD_LIGHT_SEQ = 1,
 	EE_LCD_LIGHT_COUNT = 5,
-	EE_LCD_LIGHT_ADDR = EEPROM_START_ADR,
-	EE_LCD_LIGHT_END = EE_LCD_LIGHT_ADDR + (EE_LCD_LIGHT_SIZE + 1) * EE_LCD_LIGHT_COUNT,
+	EE_LCD_LIGHT_QUIET = 10,
+	EE_LCD_LIGHT_COUNTER = 0,
+	EE_LCD_LIGHT_PRIORITY = 0,
+	EE_LCD_LIGHT_ADDR = EEPROM_PAGE_ALIGN(EEPROM_START_ADR),
+	EE_LCD_LIGHT_END = EE_LCD_LIGHT_ADDR + EEPROM_RING_BYTES(EE_LCD_LIGHT_SIZE + EE_LCD_LIGHT_SEQ + EEPROM_CRC_SIZE, EE_LCD_LIGHT_COUNT) + 2 * EE_LCD_LIGHT_COUNTER,
 
 	EE_BAT_MIN_V_SIZE = sizeof(uint16_t),
+	EE_BAT_MIN_V_SEQ = 1,
 	EE_BAT_MIN_V_COUNT = 3,
-	EE_BAT_MIN_V_ADDR = EE_LCD_LIGHT_END,
-	EE_BAT_MIN_V_END = EE_BAT_MIN_V_ADDR + (EE_BAT_MIN_V_SIZE + 1) * EE_BAT_MIN_V_COUNT,
+	EE_BAT_MIN_V_QUIET = 10,
+	EE_BAT_MIN_V_COUNTER = 0,
+	EE_BAT_MIN_V_PRIORITY = 0,
+	EE_BAT_MIN_V_ADDR = EEPROM_PAGE_ALIGN(EE_LCD_LIGHT_END),
+	EE_BAT_MIN_V_END = EE_BAT_MIN_V_ADDR + EEPROM_RING_BYTES(EE_BAT_MIN_V_SIZE + EE_BAT_MIN_V_SEQ + EEPROM_CRC_SIZE, EE_BAT_MIN_V_COUNT) + 2 * EE_BAT_MIN_V_COUNTER,
+
+	EEPROM_DATA_SIZE = EE_LCD_LIGHT_SIZE + EE_BAT_MIN_V_SIZE,
 
 };
 
@@ -150,61 +216,780 @@ enum {
 // !!!!!!!!!!!!!!            Не забываем указать индекс последней переменной          !!!!!!!!!!!!!!!!!!!!!!
 extern uint8_t error_eeprom_overflow[EE_BAT_MIN_V_END > EEPROM_SIZE ? -1 : 0];
 
+// Значение параметра должно помещаться в запись журнала (если здесь компилятор выдает ошибку - увеличьте EEPROM_LOG_VALUE_SIZE)
+extern uint8_t error_eeprom_log_value[(EEPROM_USE_LOG && (EE_LCD_LIGHT_SIZE > EEPROM_LOG_VALUE_SIZE || EE_BAT_MIN_V_SIZE > EEPROM_LOG_VALUE_SIZE)) ? -1 : 0];
+
 const param_eeprom_t param_eeprom[] PROGMEM = {
-	{EE_LCD_LIGHT_SIZE, EE_LCD_LIGHT_COUNT, EE_LCD_LIGHT_ADDR},  //  Индекс 0, EE_LCD_LIGHT, тип uint8_t, 	количество элементов 5
-	{EE_BAT_MIN_V_SIZE, EE_BAT_MIN_V_COUNT, EE_BAT_MIN_V_ADDR},  //  Индекс 1, EE_BAT_MIN_V, тип uint16_t, 	количество элементов 100
+	{EE_LCD_LIGHT_SIZE, EE_LCD_LIGHT_SEQ, EE_LCD_LIGHT_COUNT, EE_LCD_LIGHT_ADDR, EE_LCD_LIGHT_QUIET, EE_LCD_LIGHT_COUNTER, EE_LCD_LIGHT_PRIORITY},  //  Индекс 0, EE_LCD_LIGHT, тип uint8_t, 	количество элементов 5
+	{EE_BAT_MIN_V_SIZE, EE_BAT_MIN_V_SEQ, EE_BAT_MIN_V_COUNT, EE_BAT_MIN_V_ADDR, EE_BAT_MIN_V_QUIET, EE_BAT_MIN_V_COUNTER, EE_BAT_MIN_V_PRIORITY},  //  Индекс 1, EE_BAT_MIN_V, тип uint16_t, 	количество элементов 100
 };
 
+#endif /* EEPROM_PARAM_COUNT, EEPROM_LAYOUT_FILE */
+
 
 /******************************************************************************************************************************************************************/
 
 
 
-#include <avr/eeprom.h>
-#define EEPROM_Read(address) eeprom_read_byte((uint8_t *)(uint16_t)(address))
-#define EEPROM_Write(address, data) eeprom_update_byte((uint8_t *)(uint16_t)(address), (data))
-#define EEPROM_Read_Block(address,size) eeprom_read_byte((uint8_t *)(uint16_t)(address))
-#define EEPROM_Write_Block(address, data) eeprom_update_byte((uint8_t *)(uint16_t)(address), (data))
+#define EEPROM_Read(address) EEPROM_HAL_READ_BYTE(address)
+#define EEPROM_Read_Block(ptr, address, size) EEPROM_HAL_READ_BLOCK((ptr), (address), (size))
+
+
+// Количество параметров в таблице
+#define PARAM_COUNT (sizeof(param_eeprom) / sizeof(param_eeprom[0]))
+
+// Копия значений в ОЗУ нужна только без кэша, который и так хранит значения всех параметров
+#define EEPROM_READ_CACHE_ACTIVE (EEPROM_USE_READ_CACHE && !EEPROM_USE_SHADOW)
+// Значения всех параметров в ОЗУ: кэш или копия
+#define EEPROM_VALUES_IN_RAM (EEPROM_USE_SHADOW || EEPROM_READ_CACHE_ACTIVE)
+
+// Монтирование нужно для таблицы текущих элементов, для значений в ОЗУ и для восстановления
+#define EEPROM_NEED_MOUNT (EEPROM_USE_HEAD_INDEX || EEPROM_VALUES_IN_RAM || EEPROM_RECOVERY || EEPROM_USE_LOG || EEPROM_USE_COUNTER)
+
+// Восстановление проверяет элементы по CRC (если здесь компилятор выдает ошибку - включите EEPROM_USE_CRC)
+extern uint8_t error_eeprom_recovery_needs_crc[(EEPROM_RECOVERY && !EEPROM_USE_CRC) ? -1 : 0];
+
+#if EEPROM_USE_TXN
+// Транзакции дописываются при монтировании и используют CRC элементов (если здесь компилятор выдает ошибку -
+// включите EEPROM_RECOVERY, отключите EEPROM_USE_SHADOW и EEPROM_USE_LOG)
+extern uint8_t error_eeprom_txn_needs_recovery[(!EEPROM_RECOVERY || EEPROM_USE_LOG) ? -1 : 0];
+extern uint8_t error_eeprom_txn_shadow[EEPROM_USE_SHADOW ? -1 : 0];
+// Группа записывается из прерывания как один элемент: данные, CRC и статусы, запись журнала и две отметки
+// (если здесь компилятор выдает ошибку - уменьшите EEPROM_WRITE_ARENA_SIZE или EEPROM_TXN_MAX_PARAMS)
+extern uint8_t error_eeprom_txn_group_size[EEPROM_WRITE_ARENA_SIZE + 8 * EEPROM_TXN_MAX_PARAMS + 5 > 255 ? -1 : 0];
+extern uint8_t error_eeprom_txn_slots[(EEPROM_TXN_SLOTS == 0 || EEPROM_TXN_SLOTS > 127) ? -1 : 0];
+#ifndef EEPROM_PARAM_COUNT
+// Журнал транзакций занимает EEPROM_TXN_AREA_SIZE байт перед EEPROM_START_ADR (во внешней EEPROM
+// со страничной записью EEPROM_START_ADR должен быть началом страницы)
+extern uint8_t error_eeprom_txn_area[EEPROM_TXN_AREA_SIZE > EEPROM_START_ADR ? -1 : 0];
+extern uint8_t error_eeprom_txn_page[EEPROM_PAGE_ALIGN(EEPROM_START_ADR) != EEPROM_START_ADR ? -1 : 0];
+#endif
+#endif
+
+#if EEPROM_USE_LOG
+// Проверяем журнал (если здесь компилятор выдает ошибку - увеличьте EEPROM_LOG_MAX_PARAMS или область журнала):
+// все параметры должны помещаться в таблицу, а в журнале кроме живых записей нужны два свободных элемента
+extern uint8_t error_eeprom_log_params[PARAM_COUNT > EEPROM_LOG_MAX_PARAMS ? -1 : 0];
+#ifndef EEPROM_PARAM_COUNT
+extern uint8_t error_eeprom_log_size[EEPROM_RING_SLOTS(EEPROM_SIZE - EEPROM_PAGE_ALIGN(EEPROM_START_ADR), EEPROM_LOG_RECORD_SIZE) < PARAM_COUNT + 2 ? -1 : 0];
+#endif
+#endif
+
+#if EEPROM_USE_COUNTER
+// Приращения счетчиков записываются перед элементом кольцевого буфера базы, без групп транзакций
+// (если здесь компилятор выдает ошибку - отключите EEPROM_USE_LOG и EEPROM_USE_TXN)
+extern uint8_t error_eeprom_counter[(EEPROM_USE_LOG || EEPROM_USE_TXN || EEPROM_WRITE_ARENA_SIZE < 4) ? -1 : 0];
+#endif
+
+#if EEPROM_USE_EMERGENCY
+// Аварийная запись переставляет записи буфера (если здесь компилятор выдает ошибку - отключите EEPROM_USE_TXN)
+extern uint8_t error_eeprom_emergency_txn[EEPROM_USE_TXN ? -1 : 0];
+#endif
+
+#if EEPROM_USE_GOVERNOR
+// Ограничитель оставляет значения без бюджета в кэше и считает ресурс по кольцевым буферам
+// (если здесь компилятор выдает ошибку - включите EEPROM_USE_SHADOW, отключите EEPROM_USE_LOG)
+extern uint8_t error_eeprom_governor[(!EEPROM_USE_SHADOW || EEPROM_USE_LOG || EEPROM_GOVERNOR_BURST == 0) ? -1 : 0];
+#endif
+
+#if EEPROM_HAL_PAGE_SIZE
+// Страница собирается в ОЗУ, смещения в ней 8-битные (если здесь компилятор выдает ошибку - уменьшите EEPROM_HAL_PAGE_SIZE)
+extern uint8_t error_eeprom_page_size[EEPROM_HAL_PAGE_SIZE > 128 ? -1 : 0];
+#endif
+
+// Предварительное стирание имеет смысл только при раздельных стирании и записи
+#define EEPROM_PRE_ERASE_ACTIVE (EEPROM_PRE_ERASE && EEPROM_HAL_HAS_SPLIT_PROGRAMMING)
+
+#if EEPROM_USE_HEAD_INDEX
+// Текущий (последний записанный) элемент кольцевого буфера параметра
+typedef struct {
+	uint16_t slot;    // Номер элемента в кольцевом буфере
+	uint16_t status;  // Статус (счетчик) этого элемента
+} head_index_t;
+
+// Таблица текущих элементов: заполняется в EEPROM_Mount(), обновляется в прерывании после записи элемента
+static volatile head_index_t eeprom_head_index[PARAM_COUNT];
+
+// Проверяем бюджет ОЗУ под таблицу (если здесь компилятор выдает ошибку - увеличьте EEPROM_HEAD_INDEX_RAM_BUDGET или отключите EEPROM_USE_HEAD_INDEX)
+extern uint8_t error_eeprom_head_index_budget[sizeof(eeprom_head_index) > EEPROM_HEAD_INDEX_RAM_BUDGET ? -1 : 0];
+#endif
+
+#if EEPROM_VALUES_IN_RAM
+// Кэш значений всех параметров в ОЗУ, заполняется в EEPROM_Mount(). Без EEPROM_USE_SHADOW - копия
+// значений текущих элементов, обновляется в прерывании после записи элемента
+static uint8_t eeprom_shadow[EEPROM_DATA_SIZE];
+// Смещение значения параметра в кэше
+static uint16_t eeprom_shadow_offset[PARAM_COUNT];
+#endif
+
+#if EEPROM_READ_CACHE_ACTIVE
+// Проверяем бюджет ОЗУ под копию значений (если здесь компилятор выдает ошибку - увеличьте
+// EEPROM_READ_CACHE_RAM_BUDGET или отключите EEPROM_USE_READ_CACHE)
+extern uint8_t error_eeprom_read_cache_budget[sizeof(eeprom_shadow) + sizeof(eeprom_shadow_offset) > EEPROM_READ_CACHE_RAM_BUDGET ? -1 : 0];
+#endif
 
+#if EEPROM_USE_SHADOW
+// Параметры, измененные в кэше и еще не переданные в буфер записи (бит на параметр)
+static uint8_t eeprom_shadow_dirty[(PARAM_COUNT + 7) / 8];
+// Оставшееся затишье и возраст изменения параметра, в тиках EEPROM_Tick()
+static uint8_t eeprom_shadow_quiet[PARAM_COUNT];
+static uint16_t eeprom_shadow_age[PARAM_COUNT];
+static eeprom_shadow_stats_t eeprom_shadow_stats;
+#endif
+
+#if EEPROM_USE_GOVERNOR
+// Тиков EEPROM_Tick() на один цикл стирания ячейки за срок службы (с округлением вверх)
+#define EEPROM_GOVERNOR_CYCLE_TICKS \
+	(((uint64_t)EEPROM_GOVERNOR_LIFETIME_DAYS * 86400000ULL / EEPROM_GOVERNOR_TICK_MS + EEPROM_GOVERNOR_ENDURANCE - 1) / EEPROM_GOVERNOR_ENDURANCE)
+// Долг параметра хранится в 32 битах (если здесь компилятор выдает ошибку - уменьшите срок службы или увеличьте период тика)
+extern uint8_t error_eeprom_governor_ticks[EEPROM_GOVERNOR_CYCLE_TICKS * EEPROM_GOVERNOR_BURST > 0xFFFFFFFFULL ? -1 : 0];
+// Израсходованный бюджет параметра в тиках: растет на интервал параметра при каждой записи, убывает на 1 за тик
+static uint32_t eeprom_governor_debt[PARAM_COUNT];
+
+// Тиков на одну запись: каждый элемент кольцевого буфера стирается раз в buffer_count записей
+static uint32_t EEPROM_GovernorInterval(const param_eeprom_t *param) {
+	uint32_t interval = ((uint32_t)EEPROM_GOVERNOR_CYCLE_TICKS + param->buffer_count - 1) / param->buffer_count;
+	return interval ? interval : 1;
+}
+#endif
+
+#if EEPROM_NEED_MOUNT
+static uint8_t eeprom_mounted = 0;
+#endif
+
+#if EEPROM_RECOVERY
+// Количество исправленных статусов при последнем монтировании
+static uint16_t eeprom_repair_count = 0;
+#endif
+
+#if EEPROM_PRE_ERASE_ACTIVE
+// Параметр, у которого стирается следующий элемент (PARAM_COUNT - стирать нечего)
+static volatile uint8_t pre_erase_index = PARAM_COUNT;
+#endif
+
+#if EEPROM_HAL_PAGE_SIZE
+// Внешняя EEPROM: байты элемента собираются в образ страницы в ОЗУ и записываются одной командой
+// (запись страницы занимает столько же времени, сколько запись байта). Используется только в прерывании
+static uint8_t eeprom_page[EEPROM_HAL_PAGE_SIZE];
+static uint16_t eeprom_page_base;                    // Адрес страницы
+static uint8_t eeprom_page_first, eeprom_page_last;  // Собранные байты страницы [first, last]
+static uint8_t eeprom_page_used = 0;                 // В образе есть байты
+static uint8_t eeprom_page_owner;                    // Параметр для счетчиков (первой записи страницы)
+#endif
+
+#if EEPROM_USE_COUNTER
+// Значения счетчиков вместе с приращениями, ожидающими записи (заполняется в EEPROM_Mount())
+static uint32_t eeprom_counter[PARAM_COUNT];
+// Записываемые приращения (используются только в прерывании): перед элементом базы записываются
+// counter_bytes байт области приращений с адреса counter_addr. counter_ring - пишется элемент базы,
+// тогда байты области стираются (новая активная область), иначе в них сбрасывается counter_target битов
+static uint16_t counter_addr;
+static uint16_t counter_target;
+static uint8_t counter_bytes = 0;
+static uint8_t counter_ring = 1;
+#define EEPROM_COUNTER_BYTES counter_bytes
+#define EEPROM_COUNTER_RING  counter_ring
+#else
+#define EEPROM_COUNTER_BYTES 0
+#define EEPROM_COUNTER_RING  1
+#endif
+
+#if EEPROM_USE_EMERGENCY
+// Аварийная запись: прерывание не начинает новую запись банка (EEPROM_EMERGENCY_HOLD) или
+// начинает одну (EEPROM_EMERGENCY_NEXT), стирание в свободное время не идет
+enum {
+	EEPROM_EMERGENCY_OFF = 0,
+	EEPROM_EMERGENCY_HOLD,
+	EEPROM_EMERGENCY_NEXT,
+};
+static uint8_t eeprom_emergency = EEPROM_EMERGENCY_OFF;
+// Наибольшее измеренное время программирования, мкс
+static uint16_t eeprom_program_us = EEPROM_EMERGENCY_PROGRAM_US;
+// Ожидающая запись при перестановке по приоритетам
+typedef struct {
+	uint8_t index;
+	uint8_t priority;
+	uint8_t size;
+	uint8_t offset;  // Смещение копии данных в emergency_data
+} emergency_record_t;
+// Рабочие данные EEPROM_EmergencyFlush() - статические: функция вызывается из обработчика пропадания
+// питания, возможно на глубоком стеке, и ее стек не должен зависеть от размеров буфера записи
+static emergency_record_t emergency_pending[2 * MAX_WRITE_BUFFER_SIZE];
+static uint8_t emergency_data[2 * EEPROM_WRITE_ARENA_SIZE];
+static eeprom_emergency_report_t emergency_result;
+#define EEPROM_EMERGENCY_ACTIVE eeprom_emergency
+#else
+#define EEPROM_EMERGENCY_ACTIVE 0
+#endif
+
+#if EEPROM_USE_TXN
+// Запись журнала транзакций: номер, количество параметров, параметры, CRC (сразу за параметрами)
+// и отметка в последнем байте. Отметка "не применена" записывается после всей записи журнала
+// и данных группы, "применена" - после статусов всех элементов группы
+#define EEPROM_TXN_ADDR      (EEPROM_START_ADR - EEPROM_TXN_AREA_SIZE)
+#define EEPROM_TXN_MEMBERS   2  // Смещение описаний параметров
+#define EEPROM_TXN_MEMBER    5  // Индекс, элемент и статус (младшие байты первыми)
+#define EEPROM_TXN_MARK      (EEPROM_TXN_ENTRY_SIZE - 1)
+#define EEPROM_TXN_PENDING   0xA5
+#define EEPROM_TXN_APPLIED   0x00
+
+// Параметр записываемой группы
+typedef struct {
+	param_eeprom_t param;
+	uint8_t index;
+	uint8_t offset;		// Смещение данных в арене банка
+	uint16_t slot;		// Новый элемент
+	uint16_t status;	// Статус нового элемента
+	uint8_t crc;		// CRC нового элемента
+} txn_member_t;
+
+// Транзакция открыта: заполняемый банк не передается на запись до EEPROM_Commit()
+static volatile uint8_t txn_open = 0;
+// Заполнение банка при открытии транзакции, запись была отброшена во время транзакции
+static uint8_t txn_begin_count, txn_begin_used, txn_failed;
+// Следующая запись журнала транзакций и ее номер
+static uint8_t txn_slot, txn_seq;
+// Записываемая группа (используется только в прерывании)
+static txn_member_t txn_member[EEPROM_TXN_MAX_PARAMS];
+static uint8_t txn_members;
+static uint8_t txn_crc;
+
+// Во время транзакции записи до ее начала не изменяются, новые значения добавляются в группу
+#define EEPROM_BANK_FIRST (txn_open ? txn_begin_count : 0)
+#define EEPROM_TXN_OPEN   txn_open
+#else
+#define EEPROM_BANK_FIRST 0
+#define EEPROM_TXN_OPEN   0
+#endif
+
+#if EEPROM_USE_STATS
+// Счетчики параметров и общие счетчики (programmed и isr_* изменяются в прерывании)
+static volatile eeprom_param_stats_t eeprom_param_stats[PARAM_COUNT];
+static volatile eeprom_stats_t eeprom_stats;
+#define EEPROM_STATS_ADD(index, field, n) (eeprom_param_stats[index].field += (n))
+// Записано элементов кольцевого буфера параметра (записей журнала) с запуска, изменяется в прерывании.
+// По нему оценка износа не опускается ниже записанного за время работы. EEPROM_ResetStats() не обнуляет
+#if EEPROM_USE_LOG
+static volatile uint32_t eeprom_wear_records;
+#else
+static volatile uint32_t eeprom_wear_records[PARAM_COUNT];
+#endif
+#else
+#define EEPROM_STATS_ADD(index, field, n) ((void)0)
+#endif
 
 // Чтение параметров переменной из флеш-памяти по индексу или имени переменной (3us)
 void EEPROM_ReadParam(uint8_t index, param_eeprom_t *param) {
 	param->element_size = pgm_read_byte(&(param_eeprom[index].element_size));
-	param->buffer_count = pgm_read_byte(&(param_eeprom[index].buffer_count));
+	param->seq_size = pgm_read_byte(&(param_eeprom[index].seq_size));
+	param->buffer_count = pgm_read_word(&(param_eeprom[index].buffer_count));
 	param->addr = pgm_read_word(&(param_eeprom[index].addr));
+	param->quiet = pgm_read_byte(&(param_eeprom[index].quiet));
+	param->counter = pgm_read_byte(&(param_eeprom[index].counter));
+	param->priority = pgm_read_byte(&(param_eeprom[index].priority));
 }
 
-static uint16_t EEPROM_FindCurrentAddress(const uint8_t index, param_eeprom_t *param) {
-    uint8_t status, pred_status;
-    // Заводим отдельную переменную для текущего адреса, чтобы не менять param.addr
-    uint16_t current_addr = param->addr;
-    uint16_t EeBufEnd = param->addr + (param->buffer_count - 1) * (param->element_size + 1);
-    
-    pred_status = EEPROM_Read(current_addr);
-    while (current_addr != EeBufEnd) {
-        current_addr += param->element_size + 1;
-        status = EEPROM_Read(current_addr);
-        
-        if (status != (uint8_t)(pred_status + 1)) {
-            current_addr -= (param->element_size + 1);
-            break;
-        }
-        pred_status = status;
-    }
-    
-    // Возвращаем адрес следующего байта после статуса последнего корректного элемента
-    return current_addr + 1;
+// Адрес элемента кольцевого буфера по его номеру
+static inline uint16_t EEPROM_SlotAddress(const param_eeprom_t *param, const uint16_t slot) {
+	return EEPROM_RING_ADDRESS(param->addr, param->element_size + param->seq_size + EEPROM_CRC_SIZE, slot);
 }
 
-volatile uint8_t Aaaaa;
+// Маска счетчика: статусы сравниваются по модулю 2^8 или 2^16
+static inline uint16_t EEPROM_SeqMask(const param_eeprom_t *param) {
+	return (param->seq_size == 2) ? 0xFFFF : 0xFF;
+}
+
+#if !EEPROM_USE_LOG
+// Чтение статуса элемента (младший байт первым)
+static uint16_t EEPROM_ReadStatus(const param_eeprom_t *param, const uint16_t slot) {
+	uint16_t address = EEPROM_SlotAddress(param, slot);
+	uint16_t status = EEPROM_Read(address);
+
+	if (param->seq_size == 2)
+		status |= (uint16_t)EEPROM_Read(address + 1) << 8;
+	return status;
+}
+#endif
+
+#if !(EEPROM_RECOVERY && EEPROM_USE_HEAD_INDEX) && !EEPROM_USE_LOG
+// Поиск последнего записанного элемента. Возвращает номер элемента и его статус.
+// Статусы элементов идут подряд (s[0], s[0]+1, ...) до последнего записанного, после него - старые
+// значения предыдущего круга. Условие "s[i] - s[0] == i" выполняется только до последнего элемента,
+// поэтому он находится двоичным поиском за log2(buffer_count) чтений EEPROM
+static uint16_t EEPROM_SearchHead(const param_eeprom_t *param, uint16_t *status) {
+	uint16_t mask = EEPROM_SeqMask(param);
+	uint16_t first_status = EEPROM_ReadStatus(param, 0);
+	uint16_t lo = 0;
+	uint16_t hi = param->buffer_count - 1;
+
+	while (lo < hi) {
+		uint16_t mid = lo + (hi - lo + 1) / 2;
+
+		if (((EEPROM_ReadStatus(param, mid) - first_status) & mask) == mid)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	*status = (first_status + lo) & mask;
+	return lo;
+}
+#endif
+
+#if EEPROM_USE_CRC || EEPROM_USE_LOG
+// CRC-8 (полином 0x07, как _crc8_ccitt_update в avr-libc)
+uint8_t EEPROM_Crc8(uint8_t crc, const uint8_t data) {
+	crc ^= data;
+	for (uint8_t i = 0; i < 8; i++)
+		crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+	return crc;
+}
+#endif
+
+#if EEPROM_USE_CRC
+
+// Начало CRC элемента: байты статуса (младший первым), далее по CRC добавляются байты данных
+static uint8_t EEPROM_CrcStatus(const param_eeprom_t *param, const uint16_t status) {
+	uint8_t crc = EEPROM_Crc8(0xFF, (uint8_t)status);
+
+	if (param->seq_size == 2)
+		crc = EEPROM_Crc8(crc, (uint8_t)(status >> 8));
+	return crc;
+}
+#endif
+
+#if EEPROM_RECOVERY
+// Проверка CRC элемента. Статус элемента возвращается в *status
+static uint8_t EEPROM_CheckSlot(const param_eeprom_t *param, const uint16_t slot, uint16_t *status) {
+	uint16_t address = EEPROM_SlotAddress(param, slot) + param->seq_size;
+
+	*status = EEPROM_ReadStatus(param, slot);
+	uint8_t crc = EEPROM_CrcStatus(param, *status);
+	for (uint8_t i = 0; i < param->element_size; i++)
+		crc = EEPROM_Crc8(crc, EEPROM_Read(address + i));
+	return EEPROM_Read(address + param->element_size) == crc;
+}
+
+// Исправление статуса элемента (блокирующая запись)
+static void EEPROM_RepairStatus(const param_eeprom_t *param, const uint16_t slot, const uint16_t status) {
+	uint16_t address = EEPROM_SlotAddress(param, slot);
+
+	if (EEPROM_ReadStatus(param, slot) == (status & EEPROM_SeqMask(param)))
+		return;
+	EEPROM_HAL_WRITE_BYTE(address, (uint8_t)status);
+	if (param->seq_size == 2)
+		EEPROM_HAL_WRITE_BYTE(address + 1, (uint8_t)(status >> 8));
+	eeprom_repair_count++;
+}
+
+// Восстановление кольцевого буфера за один последовательный проход по элементам.
+// base - статус, который должен быть у элемента 0 (определяется по первому целому элементу).
+// Текущий элемент - последний в непрерывной цепочке целых элементов со статусами base + номер.
+// Статусы исправляются так, чтобы двоичный поиск находил тот же элемент: элементы перед первым
+// целым (прерванная запись элемента 0) включаются в цепочку, а элементы после текущего, статус
+// которых продолжает цепочку (прерванная или испорченная запись), получают статус предыдущего круга
+static uint16_t EEPROM_Recover(const param_eeprom_t *param, uint16_t *status) {
+	uint16_t mask = EEPROM_SeqMask(param);
+	uint16_t first = param->buffer_count;  // Первый целый элемент
+	uint16_t head = 0, base = 0, slot_status;
+	uint8_t chain = 0;                     // Цепочка от первого целого элемента еще не прервана
+
+	for (uint16_t slot = 0; slot < param->buffer_count; slot++) {
+		uint8_t valid = EEPROM_CheckSlot(param, slot, &slot_status);
+		uint16_t expected = (base + slot) & mask;
+
+		if (first == param->buffer_count) {
+			if (!valid)
+				continue;
+			first = head = slot;
+			base = (slot_status - slot) & mask;
+			chain = 1;
+			for (uint16_t i = 0; i < first; i++)
+				EEPROM_RepairStatus(param, i, base + i);
+		} else if (chain && valid && slot_status == expected) {
+			head = slot;
+		} else {
+			chain = 0;
+			if (slot_status == expected)
+				EEPROM_RepairStatus(param, slot, expected - param->buffer_count);
+		}
+	}
+
+	if (first == param->buffer_count) {
+		// Целых элементов нет (чистая EEPROM) - как при двоичном поиске, текущий элемент 0
+		*status = EEPROM_ReadStatus(param, 0);
+		return 0;
+	}
+	*status = (base + head) & mask;
+	return head;
+}
+
+uint16_t EEPROM_GetRepairCount(void) {
+	return eeprom_repair_count;
+}
+#endif
+
+#if EEPROM_USE_TXN
+static inline uint16_t EEPROM_TxnAddress(const uint8_t slot) {
+	return EEPROM_RING_ADDRESS(EEPROM_TXN_ADDR, EEPROM_TXN_ENTRY_SIZE, slot);
+}
+
+static inline uint8_t EEPROM_TxnNextSlot(const uint8_t slot) {
+	return (slot + 1 == EEPROM_TXN_SLOTS) ? 0 : slot + 1;
+}
+
+// Проверка CRC записи журнала транзакций. Номер записи и количество параметров возвращаются в *seq и *count
+static uint8_t EEPROM_TxnCheck(const uint8_t slot, uint8_t *seq, uint8_t *count) {
+	uint16_t address = EEPROM_TxnAddress(slot);
+	uint8_t crc = 0xFF;
+
+	*seq = EEPROM_Read(address);
+	*count = EEPROM_Read(address + 1);
+	if (*count == 0 || *count > EEPROM_TXN_MAX_PARAMS)
+		return 0;
+	uint8_t size = EEPROM_TXN_MEMBERS + EEPROM_TXN_MEMBER * *count;
+	for (uint8_t i = 0; i < size; i++)
+		crc = EEPROM_Crc8(crc, EEPROM_Read(address + i));
+	return EEPROM_Read(address + size) == crc;
+}
+
+// Поиск последней записи журнала транзакций (записи идут по кругу с номерами подряд, последняя -
+// та, за которой нет целой записи со следующим номером). Если ее отметка "не применена", данные
+// и CRC всех элементов группы уже записаны - дописываем их статусы. Иначе элементы группы без
+// статусов не проходят проверку CRC и откатываются при восстановлении кольцевых буферов
+static void EEPROM_TxnMount(void) {
+	param_eeprom_t param;
+	uint8_t seq, count, next_seq, next_count;
+
+	txn_slot = 0;
+	txn_seq = 0;
+	for (uint8_t slot = 0; slot < EEPROM_TXN_SLOTS; slot++) {
+		if (!EEPROM_TxnCheck(slot, &seq, &count))
+			continue;
+		uint8_t next = EEPROM_TxnNextSlot(slot);
+		if (EEPROM_TxnCheck(next, &next_seq, &next_count) && next_seq == (uint8_t)(seq + 1))
+			continue;
+
+		txn_slot = next;
+		txn_seq = seq + 1;
+		uint16_t address = EEPROM_TxnAddress(slot);
+		if (EEPROM_Read(address + EEPROM_TXN_MARK) != EEPROM_TXN_PENDING)
+			return;
+		for (uint8_t m = 0; m < count; m++) {
+			uint16_t member = address + EEPROM_TXN_MEMBERS + EEPROM_TXN_MEMBER * m;
+			uint8_t index = EEPROM_Read(member);
+			uint16_t element = EEPROM_Read(member + 1) | (uint16_t)EEPROM_Read(member + 2) << 8;
+			uint16_t status = EEPROM_Read(member + 3) | (uint16_t)EEPROM_Read(member + 4) << 8;
+			if (index >= PARAM_COUNT)
+				continue;
+			EEPROM_ReadParam(index, &param);
+			if (element < param.buffer_count)
+				EEPROM_RepairStatus(&param, element, status);
+		}
+		EEPROM_HAL_WRITE_BYTE(address + EEPROM_TXN_MARK, EEPROM_TXN_APPLIED);
+		return;
+	}
+}
+#endif
+
+#if EEPROM_USE_LOG
+uint8_t EEPROM_LogElementSize(const uint8_t index) {
+	if (index >= PARAM_COUNT)
+		return 0;
+	uint8_t size = pgm_read_byte(&(param_eeprom[index].element_size));
+	return (size <= EEPROM_LOG_VALUE_SIZE) ? size : 0;
+}
+
+// Чтение значения параметра из журнала: без записей значение считается стертым (0xFF)
+static void EEPROM_ReadValue(const uint16_t address, void *ptr, const uint8_t size) {
+	if (address == EEPROM_LOG_NONE)
+		memset(ptr, 0xFF, size);
+	else
+		EEPROM_Read_Block(ptr, address, size);
+}
+#endif
+
+#if EEPROM_USE_COUNTER
+// Область приращений счетчика: активная - по четности статуса текущего элемента базы
+static uint16_t EEPROM_CounterRegion(const param_eeprom_t *param, const uint16_t status) {
+	uint16_t ring = EEPROM_RING_BYTES(param->element_size + param->seq_size + EEPROM_CRC_SIZE, param->buffer_count);
+	return param->addr + ring + (status & 1) * param->counter;
+}
+
+// Количество сброшенных битов в области приращений
+static uint16_t EEPROM_CounterCleared(const uint16_t address, const uint8_t size) {
+	uint16_t cleared = 0;
+
+	for (uint8_t i = 0; i < size; i++) {
+		uint8_t bits = ~EEPROM_Read(address + i);
+		for (; bits; bits &= bits - 1)
+			cleared++;
+	}
+	return cleared;
+}
+
+// База счетчика из элемента кольцевого буфера (младший байт первым), стертый элемент - 0
+static uint32_t EEPROM_CounterBase(const param_eeprom_t *param, const uint16_t slot) {
+	uint16_t address = EEPROM_SlotAddress(param, slot) + param->seq_size;
+	uint32_t base = 0;
+
+	for (uint8_t i = 4; i > 0; i--)
+		base = (base << 8) | EEPROM_Read(address + i - 1);
+	return (base == 0xFFFFFFFFUL) ? 0 : base;
+}
+#endif
+
+void EEPROM_Mount(void) {
+#if EEPROM_NEED_MOUNT
+	param_eeprom_t param;
+	uint16_t status, slot;
+#if EEPROM_VALUES_IN_RAM
+	uint16_t offset = 0;
+#endif
+
+#if EEPROM_RECOVERY
+	eeprom_repair_count = 0;
+#endif
+#if EEPROM_USE_TXN
+	// Прерванная группа дописывается до восстановления кольцевых буферов
+	EEPROM_TxnMount();
+#endif
+#if EEPROM_USE_LOG
+	(void)param;
+	(void)status;
+	(void)slot;
+	EEPROM_LogMount(EEPROM_START_ADR, EEPROM_SIZE);
+#if EEPROM_VALUES_IN_RAM
+	for (uint8_t index = 0; index < PARAM_COUNT; index++) {
+		EEPROM_ReadParam(index, &param);
+		eeprom_shadow_offset[index] = offset;
+		EEPROM_ReadValue(EEPROM_LogFind(index), &eeprom_shadow[offset], param.element_size);
+		offset += param.element_size;
+	}
+#endif
+#else
+	for (uint8_t index = 0; index < PARAM_COUNT; index++) {
+		EEPROM_ReadParam(index, &param);
+#if EEPROM_RECOVERY
+		// Текущий элемент находится тем же проходом, что и проверка CRC
+		slot = EEPROM_Recover(&param, &status);
+#else
+		slot = EEPROM_SearchHead(&param, &status);
+#endif
+		(void)slot;
+#if EEPROM_USE_HEAD_INDEX
+		eeprom_head_index[index].slot = slot;
+		eeprom_head_index[index].status = status;
+#endif
+#if EEPROM_USE_COUNTER
+		if (param.counter)
+			eeprom_counter[index] = EEPROM_CounterBase(&param, slot)
+			                      + EEPROM_CounterCleared(EEPROM_CounterRegion(&param, status), param.counter);
+#endif
+#if EEPROM_VALUES_IN_RAM
+		// Загружаем текущее значение параметра в кэш
+		eeprom_shadow_offset[index] = offset;
+		EEPROM_Read_Block(&eeprom_shadow[offset], EEPROM_SlotAddress(&param, slot) + param.seq_size, param.element_size);
+		offset += param.element_size;
+#endif
+#if EEPROM_USE_GOVERNOR
+		// Бюджет не хранится в EEPROM: после сброса он накапливается заново с нуля,
+		// иначе при циклических сбросах каждая загрузка получала бы полный запас записей
+		eeprom_governor_debt[index] = EEPROM_GOVERNOR_BURST * EEPROM_GovernorInterval(&param);
+#endif
+	}
+#endif
+	eeprom_mounted = 1;
+#endif
+}
+
+#if EEPROM_USE_STATS
+// Учет времени поиска текущего элемента (из основного цикла и из прерывания)
+static void EEPROM_StatsLookup(const uint16_t start) {
+	uint16_t cycles = EEPROM_HAL_CYCLES() - start;
+
+	EEPROM_HAL_ATOMIC_BLOCK() {
+		eeprom_stats.lookups++;
+		eeprom_stats.lookup_cycles += cycles;
+	}
+}
+#endif
+
+#if !EEPROM_USE_LOG
+// Текущий элемент параметра: из таблицы в ОЗУ, либо поиском по EEPROM если таблица отключена
+static uint16_t EEPROM_LookupHead(const uint8_t index, const param_eeprom_t *param, uint16_t *status) {
+#if EEPROM_USE_HEAD_INDEX
+	(void)param;
+	if (!eeprom_mounted)
+		EEPROM_Mount();
+	// Таблица обновляется в прерывании, читаем оба поля атомарно
+	uint16_t slot;
+	EEPROM_HAL_ATOMIC_BLOCK() {
+		slot = eeprom_head_index[index].slot;
+		*status = eeprom_head_index[index].status;
+	}
+	return slot;
+#else
+	(void)index;
+#if EEPROM_RECOVERY
+	if (!eeprom_mounted)
+		EEPROM_Mount();
+#endif
+	return EEPROM_SearchHead(param, status);
+#endif
+}
+
+static uint16_t EEPROM_FindHead(const uint8_t index, const param_eeprom_t *param, uint16_t *status) {
+#if EEPROM_USE_STATS
+	uint16_t start = EEPROM_HAL_CYCLES();
+	uint16_t slot = EEPROM_LookupHead(index, param, status);
+	EEPROM_StatsLookup(start);
+	return slot;
+#else
+	return EEPROM_LookupHead(index, param, status);
+#endif
+}
+
+#if !EEPROM_READ_CACHE_ACTIVE
+static uint16_t EEPROM_FindCurrentAddress(const uint8_t index, const param_eeprom_t *param) {
+	uint16_t status;
+	uint16_t slot = EEPROM_FindHead(index, param, &status);
+
+	// Возвращаем адрес следующего байта после статуса последнего корректного элемента
+	return EEPROM_SlotAddress(param, slot) + param->seq_size;
+}
+#endif
+#elif !EEPROM_READ_CACHE_ACTIVE
+// Адрес данных последней записи параметра в журнале или EEPROM_LOG_NONE
+static uint16_t EEPROM_FindCurrentAddress(const uint8_t index, const param_eeprom_t *param) {
+	(void)param;
+	if (!eeprom_mounted)
+		EEPROM_Mount();
+#if EEPROM_USE_STATS
+	uint16_t start = EEPROM_HAL_CYCLES();
+	uint16_t address = EEPROM_LogFind(index);
+	EEPROM_StatsLookup(start);
+	return address;
+#else
+	return EEPROM_LogFind(index);
+#endif
+}
+#endif
+
+// Поиск последней записи параметра среди записей банка [first, end).
+// Возвращает номер записи или MAX_WRITE_BUFFER_SIZE, если ее нет
+static uint8_t eeprom_bank_last(volatile write_bank_t *bank, const uint8_t index, const uint8_t first, const uint8_t end) {
+	for (uint8_t i = end; i > first; i--) {
+		if (bank->record[i - 1].index == index)
+			return i - 1;
+	}
+	return MAX_WRITE_BUFFER_SIZE;
+}
+
+static inline uint8_t eeprom_bank_find(volatile write_bank_t *bank, const uint8_t index, const uint8_t first) {
+	return eeprom_bank_last(bank, index, first, bank->count);
+}
+
+#if !EEPROM_USE_SHADOW
+// Значение параметра, ожидающее записи: последняя запись в заполняемом банке (во время транзакции -
+// включая еще не подтвержденные), иначе в записываемом банке. Вызывается в критической секции.
+// Возвращает 0, если параметра в буфере записи нет и значение в EEPROM самое новое
+static uint8_t eeprom_writebuffer_forward(const uint8_t index, void *ptr, const uint8_t size) {
+	volatile write_bank_t *bank = &eeprom_bank[eeprom_fill_bank];
+	uint8_t found = eeprom_bank_find(bank, index, 0);
+
+	if (found == MAX_WRITE_BUFFER_SIZE && eeprom_busy_flag) {
+		bank = &eeprom_bank[eeprom_fill_bank ^ 1];
+		found = eeprom_bank_find(bank, index, 0);
+	}
+	if (found == MAX_WRITE_BUFFER_SIZE)
+		return 0;
+	for (uint8_t i = 0; i < size; i++)
+		((uint8_t *)ptr)[i] = bank->data[bank->record[found].offset + i];
+	return 1;
+}
+#endif
+
+#if !EEPROM_VALUES_IN_RAM
+// Чтение значения из EEPROM по адресу данных текущего элемента (записи журнала)
+static inline void EEPROM_ReadCurrent(const uint8_t index, const param_eeprom_t *param, void *ptr, const uint8_t size) {
+#if EEPROM_USE_LOG
+	EEPROM_ReadValue(EEPROM_FindCurrentAddress(index, param), ptr, size);
+#else
+	EEPROM_Read_Block(ptr, EEPROM_FindCurrentAddress(index, param), size);
+#endif
+}
+#endif
+
+// Чтение текущего значения параметра: из кэша в ОЗУ, если он включен, иначе из буфера записи,
+// если значение еще не записано, и только затем из копии значений в ОЗУ или из EEPROM
+uint8_t EEPROM_TryReadParamValue(const uint8_t index, const param_eeprom_t *param, void *ptr, const uint8_t size) {
+	uint8_t done = 1;
+
+#if EEPROM_USE_COUNTER
+	// Счетчики читаются из ОЗУ
+	if (param->counter) {
+		uint32_t value = EEPROM_ReadCounter(index);
+		memcpy(ptr, &value, size);
+		return 1;
+	}
+#endif
+#if EEPROM_NEED_MOUNT
+	// Монтирование (однократно, блокирующее) - до критической секции
+	if (!eeprom_mounted)
+		EEPROM_Mount();
+#endif
+#if EEPROM_USE_SHADOW
+	(void)param;
+	memcpy(ptr, &eeprom_shadow[eeprom_shadow_offset[index]], size);
+#elif EEPROM_READ_CACHE_ACTIVE
+	// Прерывание не может изменить значение между поиском в буфере и копированием
+	EEPROM_HAL_ATOMIC_BLOCK() {
+		if (!eeprom_writebuffer_forward(index, ptr, size)) {
+			(void)param;
+			memcpy(ptr, &eeprom_shadow[eeprom_shadow_offset[index]], size);
+		}
+	}
+#else
+	uint8_t read = 0, irq = 0;
+
+	// В критической секции - только поиск в буфере и проверка готовности. Если EEPROM свободна,
+	// прерывание готовности запрещается до конца чтения: оно не начнет программирование, пока
+	// ищется текущий элемент и читается EEPROM, а остальные прерывания при этом разрешены
+	EEPROM_HAL_ATOMIC_BLOCK() {
+		if (!eeprom_writebuffer_forward(index, ptr, size)) {
+			if (EEPROM_HAL_BUSY()) {
+				done = 0;
+			} else {
+				read = 1;
+				irq = EEPROM_HAL_READY_IRQ_ENABLED() != 0;
+				EEPROM_HAL_READY_IRQ_DISABLE();
+			}
+		}
+	}
+	if (read) {
+		EEPROM_ReadCurrent(index, param, ptr, size);
+		if (irq)
+			EEPROM_HAL_READY_IRQ_ENABLE();
+	}
+#endif
+	return done;
+}
+
+// Без значений в ОЗУ чтение ждет окончания программирования байта с разрешенными прерываниями и повторяется,
+// если прерывание готовности успело начать следующий байт
+void EEPROM_ReadParamValue(const uint8_t index, const param_eeprom_t *param, void *ptr, const uint8_t size) {
+	while (!EEPROM_TryReadParamValue(index, param, ptr, size))
+		EEPROM_HAL_WAIT_READY();
+}
 
 uint8_t EEPROM_ReadWearLeveledByte(const uint8_t index) {
 	param_eeprom_t param;
 	 // Чтение данных о параметре из flash
 	EEPROM_ReadParam(index, &param);  // index — это индекс в массиве param_eeprom
 	if (param.element_size != 1) return 0;
-	uint16_t address = EEPROM_FindCurrentAddress(index, &param);
-	return eeprom_read_byte((const uint8_t*)(uint16_t)address);
+	uint8_t value;
+	EEPROM_ReadParamValue(index, &param, &value, sizeof(value));
+	return value;
 }
 
 uint16_t EEPROM_ReadWearLeveledWord(const uint8_t index) {
@@ -212,8 +997,9 @@ uint16_t EEPROM_ReadWearLeveledWord(const uint8_t index) {
 	// Чтение данных о параметре из flash
 	EEPROM_ReadParam(index, &param);  // index — это индекс в массиве param_eeprom
 	if (param.element_size != 2) return 0;
-	uint16_t address = EEPROM_FindCurrentAddress(index, &param);
-	return eeprom_read_word((const uint16_t*)address);
+	uint16_t value;
+	EEPROM_ReadParamValue(index, &param, &value, sizeof(value));
+	return value;
 }
 
 // Читаем парамерт из EEPROM количество считанных байт выбирается минимальным
@@ -222,90 +1008,1316 @@ void EEPROM_ReadWearLeveledBlock(const uint8_t index, void * ptr, uint8_t size)
 	
 	// Чтение данных о параметре из flash
 	EEPROM_ReadParam(index, &param);  // index — это индекс в массиве param_eeprom
-	uint16_t address = EEPROM_FindCurrentAddress(index, &param);
 	if ( size > param.element_size )
 	size = param.element_size;
-	eeprom_read_block(ptr,(void*)address,size);
+	EEPROM_ReadParamValue(index, &param, ptr, size);
+}
+
+uint8_t EEPROM_TryReadWearLeveledBlock(const uint8_t index, void *ptr, uint8_t size) {
+	param_eeprom_t param;
+
+	EEPROM_ReadParam(index, &param);
+	if (size > param.element_size)
+		size = param.element_size;
+	return EEPROM_TryReadParamValue(index, &param, ptr, size);
 }
 
 
 uint8_t EEPROM_CompareData(uint16_t eeprom_addr, const void *data, uint8_t size) {
 	for (uint8_t i = 0; i < size; i++) {
-		if (eeprom_read_byte((const uint8_t *)(eeprom_addr + i)) != ((const uint8_t *)data)[i]) {
+		if (EEPROM_Read(eeprom_addr + i) != ((const uint8_t *)data)[i]) {
 			return 0; // есть различия
 		}
 	}
 	return 1; // данные идентичны
 }
 
-void eeprom_writebuffer_add(const uint16_t *addr, const uint8_t *newStatus, const uint8_t *data, const uint8_t *data_size);
+// Сравнение данных с копией в арене банка
+static uint8_t eeprom_bank_compare(volatile write_bank_t *bank, const uint8_t offset, const void *data, const uint8_t size) {
+	for (uint8_t i = 0; i < size; i++) {
+		if (bank->data[offset + i] != ((const uint8_t *)data)[i])
+			return 0;
+	}
+	return 1;
+}
 
-void EEPROM_WriteWearLeveled(const uint8_t index, const void * data) {
-  param_eeprom_t param;
-  
-  // Чтение данных о параметре из flash
-  EEPROM_ReadParam(index, &param);  // index — это индекс в массиве param_eeprom
-  uint16_t address = EEPROM_FindCurrentAddress(index, &param) -1; // -1 мы получаем адрес начало блока, а не записанных данных
-  if (EEPROM_CompareData(address+1,data,param.element_size))  return;
-  uint8_t newStatusValue = EEPROM_Read(address) + 1;
-  // Move pointer to the next element in the buffer, wrapping around if necessary
-  address += param.element_size + 1;
-  // получаем адрес следующего за пределами блока
-  uint16_t EeBufOffBlock = param.addr + param.buffer_count * (param.element_size + 1); 
-  if (address == EeBufOffBlock) // если полученный адрес равен адресу за пределами блока, то какого быть не может и мы меняем его на начальный
-    address = param.addr;
-  eeprom_writebuffer_add(&address,&newStatusValue, data, &param.element_size);
-}
-
-// Функция для добавления записи в буфер
-void eeprom_writebuffer_add(const uint16_t *addr, const uint8_t *newStatus, const uint8_t *data, const uint8_t *data_size) {
-	// Проверка заполненности буфера
-	if (eeprom_busy_flag) return;
-	uint8_t next_head = (eeprom_writebuffer_head + 1) % MAX_WRITE_BUFFER_SIZE;
-	if (next_head == eeprom_writebuffer_tail) {
-		// Буфер переполнен, можно выполнить обработку ошибки
+static void eeprom_bank_copy(volatile write_bank_t *bank, const uint8_t offset, const void *data, const uint8_t size) {
+	for (uint8_t i = 0; i < size; i++)
+		bank->data[offset + i] = ((const uint8_t *)data)[i];
+}
+
+#if EEPROM_READ_CACHE_ACTIVE
+// Элемент записан: копия значения параметра в ОЗУ обновляется вместе с текущим элементом. Вызывается из прерывания
+static void EEPROM_CacheStore(volatile write_bank_t *bank, const uint8_t index, const uint8_t offset) {
+	uint8_t size = pgm_read_byte(&(param_eeprom[index].element_size));
+
+	for (uint8_t i = 0; i < size; i++)
+		eeprom_shadow[eeprom_shadow_offset[index] + i] = bank->data[offset + i];
+}
+#endif
+
+// Добавление новой записи в банк. Вызывается в критической секции.
+// Возвращает 0, если в банке нет места под запись или под копию данных
+static uint8_t eeprom_bank_append(volatile write_bank_t *bank, const uint8_t index, const void *data, const uint8_t size) {
+	if (bank->count >= MAX_WRITE_BUFFER_SIZE || bank->used + size > EEPROM_WRITE_ARENA_SIZE)
+		return 0;
+	bank->record[bank->count].index = index;
+	bank->record[bank->count].offset = bank->used;
+	eeprom_bank_copy(bank, bank->used, data, size);
+	bank->used += size;
+	bank->count++;
+#if EEPROM_USE_STATS
+	if (bank->count > eeprom_stats.queue_peak)
+		eeprom_stats.queue_peak = bank->count;
+#endif
+	return 1;
+}
+
+// Результат eeprom_writebuffer_add(): новая запись в буфере означает еще одну запись элемента в EEPROM
+enum {
+	EEPROM_ADD_DROPPED = 0,  // Буфер переполнен, запись отброшена
+	EEPROM_ADD_KEPT,         // Данные заменили ожидающую запись или совпали с EEPROM
+	EEPROM_ADD_QUEUED,       // В буфер добавлена новая запись
+};
+
+// Функция для добавления записи в буфер: повторная запись того же параметра заменяет данные
+// (побеждает последняя), запись совпадающего с EEPROM значения пропускается.
+// Возвращает EEPROM_ADD_DROPPED (0), если буфер переполнен и запись отброшена
+static uint8_t eeprom_writebuffer_add(const uint8_t index, const param_eeprom_t *param, const void *data) {
+	uint8_t found, same, added = 0;
+
+#if EEPROM_USE_LOG
+	// Параметр не помещается в запись журнала (таблица без проверки error_eeprom_log_value)
+	if (EEPROM_LogElementSize(index) == 0)
+		return EEPROM_ADD_DROPPED;
+#endif
+#if EEPROM_READ_CACHE_ACTIVE
+	// Сравнение идет с копией значений в ОЗУ, она загружается при монтировании
+	if (!eeprom_mounted)
+		EEPROM_Mount();
+#endif
+
+	// Параметр уже ждет записи - просто заменяем данные
+	EEPROM_HAL_ATOMIC_BLOCK() {
+		volatile write_bank_t *bank = &eeprom_bank[eeprom_fill_bank];
+		found = eeprom_bank_find(bank, index, EEPROM_BANK_FIRST);
+		if (found != MAX_WRITE_BUFFER_SIZE)
+			eeprom_bank_copy(bank, bank->record[found].offset, data, param->element_size);
+	}
+	if (found != MAX_WRITE_BUFFER_SIZE)
+		return EEPROM_ADD_KEPT;
+
+	// Новее всего значение, которое сейчас записывается, иначе - последнее записанное в EEPROM
+	EEPROM_HAL_ATOMIC_BLOCK() {
+		volatile write_bank_t *flush = &eeprom_bank[eeprom_fill_bank ^ 1];
+		found = eeprom_busy_flag ? eeprom_bank_find(flush, index, 0) : MAX_WRITE_BUFFER_SIZE;
+#if EEPROM_USE_TXN
+		// Во время транзакции еще новее значение, добавленное в банк до ее начала
+		if (txn_open && eeprom_bank_find(&eeprom_bank[eeprom_fill_bank], index, 0) != MAX_WRITE_BUFFER_SIZE) {
+			flush = &eeprom_bank[eeprom_fill_bank];
+			found = eeprom_bank_find(flush, index, 0);
+		}
+#endif
+		same = (found != MAX_WRITE_BUFFER_SIZE) && eeprom_bank_compare(flush, flush->record[found].offset, data, param->element_size);
+#if EEPROM_READ_CACHE_ACTIVE
+		// Последнее записанное значение - в копии в ОЗУ: сравнение не читает EEPROM и не ждет ее готовности
+		if (found == MAX_WRITE_BUFFER_SIZE)
+			same = memcmp(&eeprom_shadow[eeprom_shadow_offset[index]], data, param->element_size) == 0;
+#endif
+	}
+#if !EEPROM_READ_CACHE_ACTIVE
+	if (found == MAX_WRITE_BUFFER_SIZE) {
+		uint16_t address = EEPROM_FindCurrentAddress(index, param);
+#if EEPROM_USE_LOG
+		if (address == EEPROM_LOG_NONE)
+			same = 0;
+		else
+#endif
+		same = EEPROM_CompareData(address, data, param->element_size);
+	}
+#endif
+	if (same) {
+		EEPROM_STATS_ADD(index, skipped, 1);
+		return EEPROM_ADD_KEPT;
+	}
+
+	// Добавлять записи может только основной цикл, поэтому параметр не мог появиться в банке.
+	// Банки могли поменяться местами, но тогда записи в бывшем заполняемом банке не было
+	EEPROM_HAL_ATOMIC_BLOCK() {
+		added = eeprom_bank_append(&eeprom_bank[eeprom_fill_bank], index, data, param->element_size);
+	}
+	return added ? EEPROM_ADD_QUEUED : EEPROM_ADD_DROPPED;
+}
+
+#if EEPROM_USE_COUNTER
+// Приращения счетчика в арене банка хранятся как uint32_t (младший байт первым)
+static uint32_t eeprom_bank_load32(volatile write_bank_t *bank, const uint8_t offset) {
+	uint32_t value = 0;
+
+	for (uint8_t i = 4; i > 0; i--)
+		value = (value << 8) | bank->data[offset + i - 1];
+	return value;
+}
+
+static void eeprom_bank_store32(volatile write_bank_t *bank, const uint8_t offset, uint32_t value) {
+	for (uint8_t i = 0; i < 4; i++, value >>= 8)
+		bank->data[offset + i] = (uint8_t)value;
+}
+
+uint8_t EEPROM_AddCounter(const uint8_t index, const uint16_t n) {
+	param_eeprom_t param;
+	uint8_t added = 1;
+
+	EEPROM_ReadParam(index, &param);
+	if (!param.counter)
+		return 0;
+	if (!eeprom_mounted)
+		EEPROM_Mount();
+	EEPROM_STATS_ADD(index, requested, 1);
+	if (n == 0) {
+		EEPROM_STATS_ADD(index, skipped, 1);
+		return 1;
+	}
+
+	// Приращения, еще не переданные в EEPROM, складываются в одной записи
+	EEPROM_HAL_ATOMIC_BLOCK() {
+		volatile write_bank_t *bank = &eeprom_bank[eeprom_fill_bank];
+		uint8_t found = eeprom_bank_find(bank, index, 0);
+		if (found != MAX_WRITE_BUFFER_SIZE) {
+			uint8_t offset = bank->record[found].offset;
+			eeprom_bank_store32(bank, offset, eeprom_bank_load32(bank, offset) + n);
+		} else {
+			uint8_t pending[4] = {(uint8_t)n, (uint8_t)(n >> 8), 0, 0};
+			added = eeprom_bank_append(bank, index, pending, sizeof(pending));
+		}
+	}
+	if (added)
+		eeprom_counter[index] += n;
+	else
+		EEPROM_STATS_ADD(index, dropped, 1);
+	return added;
+}
+
+uint32_t EEPROM_ReadCounter(const uint8_t index) {
+	if (!pgm_read_byte(&(param_eeprom[index].counter)))
+		return 0;
+	if (!eeprom_mounted)
+		EEPROM_Mount();
+	return eeprom_counter[index];
+}
+#endif
+
+#if EEPROM_USE_SHADOW
+static inline uint8_t EEPROM_ShadowIsDirty(const uint8_t index) {
+	return eeprom_shadow_dirty[index >> 3] & (1 << (index & 7));
+}
+
+// Передача измененного значения из кэша в буфер записи. Если буфер переполнен,
+// параметр остается измененным и будет передан на следующем тике.
+// Возвращает результат eeprom_writebuffer_add()
+static uint8_t EEPROM_ShadowQueue(const uint8_t index) {
+	param_eeprom_t param;
+
+	EEPROM_ReadParam(index, &param);
+	uint8_t added = eeprom_writebuffer_add(index, &param, &eeprom_shadow[eeprom_shadow_offset[index]]);
+	if (added == EEPROM_ADD_DROPPED) {
+		eeprom_shadow_stats.deferred++;
+		return EEPROM_ADD_DROPPED;
+	}
+	eeprom_shadow_dirty[index >> 3] &= ~(1 << (index & 7));
+	return added;
+}
+
+void EEPROM_WriteParamValue(const uint8_t index, const param_eeprom_t *param, const void *data) {
+#if EEPROM_USE_COUNTER
+	// Значение счетчика изменяется только приращениями
+	if (param->counter) {
+		EEPROM_STATS_ADD(index, dropped, 1);
 		return;
 	}
-	// Заполняем запись в буфере
-	eeprom_writebuffer[eeprom_writebuffer_head].adr_eeprom = *addr;
-	eeprom_writebuffer[eeprom_writebuffer_head].newStatus = *newStatus;
-	eeprom_writebuffer[eeprom_writebuffer_head].data_ptr = data;
-	eeprom_writebuffer[eeprom_writebuffer_head].data_size = *data_size;
-	// Сдвигаем указатель головы буфера
-	eeprom_writebuffer_head = next_head;
+#endif
+#if EEPROM_USE_LOG
+	// Параметр не помещается в запись журнала (таблица без проверки error_eeprom_log_value) - в кэше он
+	// остался бы измененным навсегда
+	if (EEPROM_LogElementSize(index) == 0) {
+		EEPROM_STATS_ADD(index, dropped, 1);
+		return;
+	}
+#endif
+	if (!eeprom_mounted)
+		EEPROM_Mount();
+	eeprom_shadow_stats.writes++;
+	EEPROM_STATS_ADD(index, requested, 1);
+
+	uint8_t *value = &eeprom_shadow[eeprom_shadow_offset[index]];
+	if (memcmp(value, data, param->element_size) == 0) {
+		EEPROM_STATS_ADD(index, skipped, 1);
+		return;
+	}
+	memcpy(value, data, param->element_size);
+
+	// Каждое изменение продлевает затишье, возраст считается от первого незаписанного изменения
+	eeprom_shadow_quiet[index] = param->quiet;
+	if (EEPROM_ShadowIsDirty(index)) {
+		eeprom_shadow_stats.merged++;
+	} else {
+		eeprom_shadow_dirty[index >> 3] |= 1 << (index & 7);
+		eeprom_shadow_age[index] = 0;
+	}
+}
+
+#if EEPROM_USE_GOVERNOR
+// Тиков до следующей разрешенной записи: долг не должен превышать EEPROM_GOVERNOR_BURST - 1 интервалов
+static uint32_t EEPROM_GovernorWait(const uint8_t index, const uint32_t interval) {
+	uint32_t allowed = (EEPROM_GOVERNOR_BURST - 1) * interval;
+	return eeprom_governor_debt[index] > allowed ? eeprom_governor_debt[index] - allowed : 0;
+}
+
+void EEPROM_GetWriteBudget(const uint8_t index, eeprom_write_budget_t *budget) {
+	param_eeprom_t param;
+
+	EEPROM_ReadParam(index, &param);
+	budget->interval = EEPROM_GovernorInterval(&param);
+	budget->wait = EEPROM_GovernorWait(index, budget->interval);
+	// После записи сверх бюджета долг может превышать EEPROM_GOVERNOR_BURST интервалов
+	uint32_t limit = EEPROM_GOVERNOR_BURST * budget->interval;
+	budget->available = (eeprom_governor_debt[index] < limit) ? (uint8_t)((limit - eeprom_governor_debt[index]) / budget->interval) : 0;
+	budget->held = EEPROM_ShadowIsDirty(index) && budget->wait;
+}
+#endif
+
+// Передача измененного значения по политике записи. С ограничителем износа значение
+// без бюджета остается в кэше и будет передано на тике, когда бюджет появится,
+// force - передается в долг (EEPROM_ForceFlush())
+static uint8_t EEPROM_ShadowRelease(const uint8_t index, const uint8_t force) {
+#if EEPROM_USE_GOVERNOR
+	param_eeprom_t param;
+
+	EEPROM_ReadParam(index, &param);
+	uint32_t interval = EEPROM_GovernorInterval(&param);
+	uint32_t wait = EEPROM_GovernorWait(index, interval);
+	if (wait && !force)
+		return 0;
+	uint8_t added = EEPROM_ShadowQueue(index);
+	// Значение, совпавшее с EEPROM или слитое с ожидающей записью, ячейки не изнашивает
+	if (added != EEPROM_ADD_QUEUED)
+		return added;
+	if (wait)
+		eeprom_shadow_stats.overdraft++;
+	// Долг не переполняется и при частых записях в долг
+	if (eeprom_governor_debt[index] > 0xFFFFFFFFUL - interval)
+		eeprom_governor_debt[index] = 0xFFFFFFFFUL;
+	else
+		eeprom_governor_debt[index] += interval;
+	return 1;
+#else
+	(void)force;
+	return EEPROM_ShadowQueue(index);
+#endif
+}
+
+void EEPROM_Tick(void) {
+	uint8_t queued = 0;
+
+	for (uint8_t index = 0; index < PARAM_COUNT; index++) {
+#if EEPROM_USE_GOVERNOR
+		if (eeprom_governor_debt[index])
+			eeprom_governor_debt[index]--;
+#endif
+		if (!EEPROM_ShadowIsDirty(index))
+			continue;
+		if (eeprom_shadow_quiet[index])
+			eeprom_shadow_quiet[index]--;
+		if (eeprom_shadow_age[index] != 0xFFFF)
+			eeprom_shadow_age[index]++;
+
+		if (eeprom_shadow_quiet[index] == 0) {
+			if (EEPROM_ShadowRelease(index, 0)) {
+				eeprom_shadow_stats.flush_quiet++;
+				queued = 1;
+			}
+		} else if (eeprom_shadow_age[index] >= EEPROM_SHADOW_MAX_AGE) {
+			if (EEPROM_ShadowRelease(index, 0)) {
+				eeprom_shadow_stats.flush_age++;
+				queued = 1;
+			}
+		}
+	}
+	if (queued)
+		StartWriteBuffer();
+}
+
+static void EEPROM_ShadowFlush(const uint8_t force) {
+	for (uint8_t index = 0; index < PARAM_COUNT; index++) {
+		if (EEPROM_ShadowIsDirty(index) && EEPROM_ShadowRelease(index, force))
+			eeprom_shadow_stats.flush_explicit++;
+	}
+	StartWriteBuffer();
+}
+
+void EEPROM_Flush(void) {
+	EEPROM_ShadowFlush(0);
+}
+
+#if EEPROM_USE_GOVERNOR
+void EEPROM_ForceFlush(void) {
+	EEPROM_ShadowFlush(1);
+}
+#endif
+
+void EEPROM_GetShadowStats(eeprom_shadow_stats_t *stats) {
+	*stats = eeprom_shadow_stats;
+}
+#else
+void EEPROM_WriteParamValue(const uint8_t index, const param_eeprom_t *param, const void *data) {
+#if EEPROM_USE_COUNTER
+	// Значение счетчика изменяется только приращениями
+	if (param->counter) {
+		EEPROM_STATS_ADD(index, dropped, 1);
+		return;
+	}
+#endif
+	EEPROM_STATS_ADD(index, requested, 1);
+	if (!eeprom_writebuffer_add(index, param, data)) {
+		EEPROM_STATS_ADD(index, dropped, 1);
+#if EEPROM_USE_TXN
+		// Группа без этой записи была бы неполной - EEPROM_Commit() отбросит ее целиком
+		if (txn_open)
+			txn_failed = 1;
+#endif
+	}
+}
+
+void EEPROM_Tick(void) {
+}
+
+void EEPROM_Flush(void) {
+	StartWriteBuffer();
+}
+#endif
+
+void EEPROM_WriteWearLeveled(const uint8_t index, const void * data) {
+	param_eeprom_t param;
+
+	EEPROM_ReadParam(index, &param);  // index — это индекс в массиве param_eeprom
+	EEPROM_WriteParamValue(index, &param, data);
+}
+
+uint16_t EEPROM_GetRamUsage(void) {
+	uint16_t size = sizeof(eeprom_bank) + sizeof(eeprom_fill_bank) + sizeof(eeprom_busy_flag)
+	              + sizeof(eeprom_flush_request) + sizeof(current_byte_index) + sizeof(record_pos);
+#if EEPROM_USE_HEAD_INDEX
+	size += sizeof(eeprom_head_index);
+#endif
+#if EEPROM_VALUES_IN_RAM
+	size += sizeof(eeprom_shadow) + sizeof(eeprom_shadow_offset);
+#endif
+#if EEPROM_USE_SHADOW
+	size += sizeof(eeprom_shadow_dirty) + sizeof(eeprom_shadow_quiet) + sizeof(eeprom_shadow_age) + sizeof(eeprom_shadow_stats);
+#endif
+#if EEPROM_USE_GOVERNOR
+	size += sizeof(eeprom_governor_debt);
+#endif
+#if EEPROM_NEED_MOUNT
+	size += sizeof(eeprom_mounted);
+#endif
+#if EEPROM_PRE_ERASE_ACTIVE
+	size += sizeof(pre_erase_index);
+#endif
+#if EEPROM_RECOVERY
+	size += sizeof(eeprom_repair_count);
+#endif
+#if EEPROM_USE_LOG
+	size += EEPROM_LogRamUsage();
+#endif
+#if EEPROM_USE_EMERGENCY
+	size += sizeof(eeprom_emergency) + sizeof(eeprom_program_us) + sizeof(emergency_pending) + sizeof(emergency_data)
+	      + sizeof(emergency_result);
+#endif
+#if EEPROM_USE_COUNTER
+	size += sizeof(eeprom_counter) + sizeof(counter_addr) + sizeof(counter_target) + sizeof(counter_bytes) + sizeof(counter_ring);
+#endif
+#if EEPROM_HAL_PAGE_SIZE
+	size += sizeof(eeprom_page) + sizeof(eeprom_page_base) + sizeof(eeprom_page_first) + sizeof(eeprom_page_last)
+	      + sizeof(eeprom_page_used) + sizeof(eeprom_page_owner);
+#endif
+#if EEPROM_USE_TXN
+	size += sizeof(txn_open) + sizeof(txn_begin_count) + sizeof(txn_begin_used) + sizeof(txn_failed)
+	      + sizeof(txn_slot) + sizeof(txn_seq) + sizeof(txn_member) + sizeof(txn_members) + sizeof(txn_crc);
+#endif
+#if EEPROM_USE_STATS
+	size += sizeof(eeprom_param_stats) + sizeof(eeprom_stats) + sizeof(eeprom_wear_records);
+#endif
+	return size;
 }
 
 void StartWriteBuffer (void){
 	// Запускаем запись 
-	if (!eeprom_busy_flag) {
-		eeprom_busy_flag = 1;
-		//current_byte_index = 1;  // После newStatus переходим к данным
-		EECR |= (1 << EERIE);
+	EEPROM_HAL_ATOMIC_BLOCK() {
+		if (!eeprom_busy_flag) {
+			// Во время транзакции банк будет отдан на запись в EEPROM_Commit()
+			if (eeprom_bank[eeprom_fill_bank].count && !EEPROM_TXN_OPEN) {
+				// Заполненный банк отдаем на запись, новые записи пойдут в другой
+				eeprom_fill_bank ^= 1;
+				eeprom_busy_flag = 1;
+				EEPROM_HAL_READY_IRQ_ENABLE();
+			}
+		} else {
+			// Идет запись предыдущего банка - этот запишется сразу после него
+			eeprom_flush_request = 1;
+		}
 	}
 }
 
-// Вектор прерывания "EEPROM Ready" для Atmega128
-ISR(EE_READY_vect){
-    static volatile const buffer_record_t *record = NULL;
-	
-    if (record == NULL || current_byte_index >= (record->data_size + 1)) {
-	    if (eeprom_writebuffer_tail == eeprom_writebuffer_head) {
-		    EECR &= ~(1 << EERIE); // Отключаем прерывание
-			record = NULL;
-		    eeprom_busy_flag = 0;
+#if EEPROM_USE_TXN
+uint8_t EEPROM_BeginTransaction(void) {
+	// Журнал транзакций и кольцевые буферы восстанавливаются до первой записи группы
+	if (!eeprom_mounted)
+		EEPROM_Mount();
+	if (txn_open)
+		return 0;
+	EEPROM_HAL_ATOMIC_BLOCK() {
+		volatile write_bank_t *bank = &eeprom_bank[eeprom_fill_bank];
+		txn_begin_count = bank->count;
+		txn_begin_used = bank->used;
+		txn_failed = 0;
+		txn_open = 1;
+	}
+	return 1;
+}
+
+// Количество разных параметров в записях банка [first, end)
+static uint8_t EEPROM_TxnParams(volatile write_bank_t *bank, const uint8_t first, const uint8_t end) {
+	uint8_t params = 0;
+
+	for (uint8_t i = first; i < end; i++) {
+		if (eeprom_bank_last(bank, bank->record[i].index, first, end) == i)
+			params++;
+	}
+	return params;
+}
+
+uint8_t EEPROM_Commit(void) {
+	uint8_t committed = 0;
+
+	if (!txn_open)
+		return 0;
+	EEPROM_HAL_ATOMIC_BLOCK() {
+		volatile write_bank_t *bank = &eeprom_bank[eeprom_fill_bank];
+		// Группа, ожидающая записи в этом банке, продолжается до конца новой транзакции
+		uint8_t group = bank->group_end ? bank->group : txn_begin_count;
+
+		if (txn_failed || EEPROM_TxnParams(bank, group, bank->count) > EEPROM_TXN_MAX_PARAMS) {
+			// Отбрасываем все записи транзакции, записи до ее начала не изменялись
+			bank->count = txn_begin_count;
+			bank->used = txn_begin_used;
+		} else {
+			if (bank->count > group) {
+				bank->group = group;
+				bank->group_end = bank->count;
+			}
+			committed = 1;
+		}
+		txn_open = 0;
+	}
+	StartWriteBuffer();
+	return committed;
+}
+#endif
+
+#if EEPROM_HAL_PAGE_SIZE
+// Добавление байта в образ страницы. Пропуски между байтами заполняются содержимым EEPROM
+static void EEPROM_PageAdd(const uint16_t address, const uint8_t data, const uint8_t owner) {
+	uint8_t offset = address % EEPROM_HAL_PAGE_SIZE;
+
+	if (!eeprom_page_used) {
+		eeprom_page_base = address - offset;
+		eeprom_page_first = eeprom_page_last = offset;
+		eeprom_page_owner = owner;
+		eeprom_page_used = 1;
+	}
+	while (offset > eeprom_page_last + 1) {
+		eeprom_page_last++;
+		eeprom_page[eeprom_page_last] = EEPROM_Read(eeprom_page_base + eeprom_page_last);
+	}
+	while (offset + 1 < eeprom_page_first) {
+		eeprom_page_first--;
+		eeprom_page[eeprom_page_first] = EEPROM_Read(eeprom_page_base + eeprom_page_first);
+	}
+	if (offset > eeprom_page_last)
+		eeprom_page_last = offset;
+	if (offset < eeprom_page_first)
+		eeprom_page_first = offset;
+	eeprom_page[offset] = data;
+}
+
+// Запись собранных байт одной командой, от первого до последнего отличающегося от EEPROM.
+// Возвращает 0, если все байты уже записаны и программирование не требуется
+static uint8_t EEPROM_PageProgram(void) {
+	uint8_t first = eeprom_page_first, last = eeprom_page_last;
+
+	eeprom_page_used = 0;
+	while (first <= last && EEPROM_Read(eeprom_page_base + first) == eeprom_page[first])
+		first++;
+	if (first > last)
+		return 0;
+	while (EEPROM_Read(eeprom_page_base + last) == eeprom_page[last])
+		last--;
+	EEPROM_HAL_PROGRAM_PAGE(eeprom_page_base + first, &eeprom_page[first], last - first + 1);
+	// Байты журнала транзакций не относятся к параметрам
+	if (eeprom_page_owner < PARAM_COUNT)
+		EEPROM_STATS_ADD(eeprom_page_owner, programmed, last - first + 1);
+	return 1;
+}
+
+// Можно ли оставить записанный элемент в образе страницы, чтобы следующие записи банка на той же странице
+// ушли той же командой. Кольцевые буферы разных параметров начинаются с новой страницы, поэтому
+// объединяются только записи журнала из банка: до освобождения банка чтение берет их значения из него.
+// Перенос из хвоста записывается сразу - его новое место видно чтению из EEPROM. Журнал в одну страницу
+// не объединяется: проверка хвоста в EEPROM_LogBegin() прочитала бы еще не записанную запись
+static uint8_t EEPROM_PageDefer(const uint8_t index) {
+#if EEPROM_USE_LOG
+	uint16_t seq, slots;
+	EEPROM_LogHead(&seq, &slots);
+	return EEPROM_LogRecordIndex() == index && slots > EEPROM_PAGE_SLOTS(EEPROM_LOG_RECORD_SIZE);
+#else
+	(void)index;
+	return 0;
+#endif
+}
+#else
+// Программирует байт в самом быстром подходящем режиме.
+// Возвращает 0, если ячейка уже содержит нужное значение и программирование не требуется
+static uint8_t EEPROM_ProgramByte(const uint16_t address, const uint8_t data) {
+	uint8_t current = EEPROM_Read(address);
+	uint8_t mode = EEPROM_HAL_ERASE_WRITE;
+
+	if (current == data)
+		return 0;
+#if EEPROM_HAL_HAS_SPLIT_PROGRAMMING
+	if ((current & data) == data)
+		mode = EEPROM_HAL_WRITE_ONLY;  // Биты только сбрасываются 1 -> 0, стирание не нужно
+	else if (data == 0xFF)
+		mode = EEPROM_HAL_ERASE_ONLY;
+#endif
+	EEPROM_HAL_PROGRAM_BYTE(address, data, mode);
+	return 1;
+}
+#endif
+
+#if EEPROM_PRE_ERASE_ACTIVE
+void EEPROM_PreErase(void) {
+#if EEPROM_NEED_MOUNT
+	// Монтирование (и восстановление) - до начала работы прерывания
+	if (!eeprom_mounted)
+		EEPROM_Mount();
+#endif
+	pre_erase_index = 0;
+	EEPROM_HAL_READY_IRQ_ENABLE();
+}
+
+// Поиск очередного нестертого байта данных (и CRC) в элементах, следующих за текущими.
+// Статус не стирается: по нему элемент остается старым до записи нового статуса
+static uint8_t EEPROM_PreEraseNext(uint16_t *address) {
+	param_eeprom_t param;
+	uint16_t status;
+
+	while (pre_erase_index < PARAM_COUNT) {
+		EEPROM_ReadParam(pre_erase_index, &param);
+		uint16_t slot = EEPROM_FindHead(pre_erase_index, &param, &status);
+		if (++slot == param.buffer_count)
+			slot = 0;
+		uint16_t data_addr = EEPROM_SlotAddress(&param, slot) + param.seq_size;
+
+		for (uint8_t i = 0; i < param.element_size + EEPROM_CRC_SIZE; i++) {
+			if (EEPROM_Read(data_addr + i) != 0xFF) {
+				*address = data_addr + i;
+				return 1;
+			}
+		}
+#if EEPROM_USE_COUNTER
+		// У счетчика стирается и неактивная область приращений, которую активирует следующая база
+		uint16_t region = param.counter ? EEPROM_CounterRegion(&param, status + 1) : 0;
+		for (uint8_t i = 0; i < param.counter; i++) {
+			if (EEPROM_Read(region + i) != 0xFF) {
+				*address = region + i;
+				return 1;
+			}
+		}
+#endif
+		pre_erase_index++;
+	}
+	return 0;
+}
+#else
+void EEPROM_PreErase(void) {
+}
+#endif
+
+#if EEPROM_USE_TXN
+// Байт записи журнала транзакций (номер, количество параметров, параметры, CRC)
+static uint8_t EEPROM_TxnEntryByte(const uint8_t pos) {
+	if (pos == 0)
+		return txn_seq;
+	if (pos == 1)
+		return txn_members;
+	uint8_t m = (pos - EEPROM_TXN_MEMBERS) / EEPROM_TXN_MEMBER;
+	uint8_t field = (pos - EEPROM_TXN_MEMBERS) % EEPROM_TXN_MEMBER;
+	if (m >= txn_members)
+		return txn_crc;
+	if (field == 0)
+		return txn_member[m].index;
+	uint16_t value = (field <= 2) ? txn_member[m].slot : txn_member[m].status;
+	return (field & 1) ? (uint8_t)value : (uint8_t)(value >> 8);
+}
+
+// Начало записи группы [group, group_end): новые элементы всех параметров группы (по последней записи
+// каждого параметра) определяются сразу, без поиска текущего элемента перед каждой записью.
+// Возвращает количество байт группы
+static uint8_t EEPROM_TxnBegin(volatile write_bank_t *bank) {
+	uint8_t bytes = 0;
+
+	txn_members = 0;
+	for (uint8_t i = bank->group_end; i > bank->group; i--) {
+		uint8_t index = bank->record[i - 1].index;
+		if (eeprom_bank_last(bank, index, bank->group, bank->group_end) != i - 1)
+			continue;  // Более поздняя запись того же параметра уже учтена
+
+		txn_member_t *member = &txn_member[txn_members++];
+		uint16_t status;
+		member->index = index;
+		member->offset = bank->record[i - 1].offset;
+		EEPROM_ReadParam(index, &member->param);
+		member->slot = EEPROM_FindHead(index, &member->param, &status);
+		if (++member->slot == member->param.buffer_count)
+			member->slot = 0;
+		member->status = (status + 1) & EEPROM_SeqMask(&member->param);
+		member->crc = EEPROM_CrcStatus(&member->param, member->status);
+		for (uint8_t j = 0; j < member->param.element_size; j++)
+			member->crc = EEPROM_Crc8(member->crc, bank->data[member->offset + j]);
+		bytes += member->param.element_size + EEPROM_CRC_SIZE + member->param.seq_size;
+	}
+
+	uint8_t entry = EEPROM_TXN_MEMBERS + EEPROM_TXN_MEMBER * txn_members;
+	txn_crc = 0xFF;
+	for (uint8_t pos = 0; pos < entry; pos++)
+		txn_crc = EEPROM_Crc8(txn_crc, EEPROM_TxnEntryByte(pos));
+	// Запись журнала с CRC и две отметки
+	return bytes + entry + 1 + 2;
+}
+
+// Байт группы по номеру: данные и CRC всех элементов, запись журнала, отметка "не применена",
+// статусы всех элементов, отметка "применена". Возвращает индекс параметра, к которому относится
+// байт, или PARAM_COUNT для байтов журнала
+static uint8_t EEPROM_TxnByte(volatile write_bank_t *bank, uint8_t pos, uint16_t *address, uint8_t *data) {
+	uint16_t entry = EEPROM_TxnAddress(txn_slot);
+	uint8_t m;
+
+	for (m = 0; m < txn_members; m++) {
+		txn_member_t *member = &txn_member[m];
+		if (pos <= member->param.element_size) {
+			*address = EEPROM_SlotAddress(&member->param, member->slot) + member->param.seq_size + pos;
+			*data = (pos < member->param.element_size) ? bank->data[member->offset + pos] : member->crc;
+			return member->index;
+		}
+		pos -= member->param.element_size + 1;
+	}
+
+	uint8_t entry_bytes = EEPROM_TXN_MEMBERS + EEPROM_TXN_MEMBER * txn_members + 1;
+	if (pos < entry_bytes) {
+		*address = entry + pos;
+		*data = EEPROM_TxnEntryByte(pos);
+		return PARAM_COUNT;
+	}
+	pos -= entry_bytes;
+	if (pos == 0) {
+		*address = entry + EEPROM_TXN_MARK;
+		*data = EEPROM_TXN_PENDING;
+		return PARAM_COUNT;
+	}
+	pos--;
+
+	for (m = 0; m < txn_members; m++) {
+		txn_member_t *member = &txn_member[m];
+		if (pos < member->param.seq_size) {
+			*address = EEPROM_SlotAddress(&member->param, member->slot) + pos;
+			*data = (uint8_t)(member->status >> (8 * pos));
+			return member->index;
+		}
+		pos -= member->param.seq_size;
+	}
+
+	*address = entry + EEPROM_TXN_MARK;
+	*data = EEPROM_TXN_APPLIED;
+	return PARAM_COUNT;
+}
+
+// Группа записана: элементы всех ее параметров становятся текущими одновременно
+static void EEPROM_TxnEnd(volatile write_bank_t *bank) {
+	(void)bank;
+	for (uint8_t m = 0; m < txn_members; m++) {
+#if EEPROM_USE_HEAD_INDEX
+		eeprom_head_index[txn_member[m].index].slot = txn_member[m].slot;
+		eeprom_head_index[txn_member[m].index].status = txn_member[m].status;
+#endif
+#if EEPROM_USE_STATS
+		eeprom_wear_records[txn_member[m].index]++;
+#endif
+#if EEPROM_READ_CACHE_ACTIVE
+		EEPROM_CacheStore(bank, txn_member[m].index, txn_member[m].offset);
+#endif
+	}
+	txn_slot = EEPROM_TxnNextSlot(txn_slot);
+	txn_seq++;
+}
+#endif
+
+#if EEPROM_USE_COUNTER
+// Начало записи приращений счетчика (n из банка): если они помещаются в активную область, сбрасываются
+// следующие n битов. Иначе стирается другая область и пишется новая база со всеми приращениями -
+// до записи ее статуса текущими остаются прежние база и область
+static void EEPROM_CounterBegin(volatile write_bank_t *bank, const uint8_t offset, const param_eeprom_t *param,
+                                const uint16_t head, const uint16_t status) {
+	uint32_t n = eeprom_bank_load32(bank, offset);
+	uint16_t region = EEPROM_CounterRegion(param, status);
+	uint16_t cleared = EEPROM_CounterCleared(region, param->counter);
+
+	if (cleared + n <= 8U * param->counter) {
+		counter_addr = region + cleared / 8;
+		counter_target = cleared % 8 + n;
+		counter_bytes = (counter_target + 7) / 8;
+		counter_ring = 0;
+	} else {
+		eeprom_bank_store32(bank, offset, EEPROM_CounterBase(param, head) + cleared + n);
+		counter_addr = EEPROM_CounterRegion(param, status + 1);
+		counter_bytes = param->counter;
+		counter_ring = 1;
+	}
+}
+
+// Байт области приращений: стирание или сброс следующих битов (не меняя уже сброшенные)
+static void EEPROM_CounterByte(const uint8_t pos, uint16_t *address, uint8_t *data) {
+	*address = counter_addr + pos;
+	if (counter_ring) {
+		*data = 0xFF;
+	} else {
+		uint16_t bits = counter_target - 8U * pos;
+		*data = EEPROM_Read(*address) & (uint8_t)(0xFF << (bits > 8 ? 8 : bits));
+	}
+}
+#endif
+
+// Обработчик прерывания готовности EEPROM: запись буфера и стирание в свободное время
+static inline void EEPROM_Ready(void) {
+    // Записываемый элемент
+    static uint8_t record_active = 0;   // 0 - запись элемента еще не начата
+    static uint8_t record_bytes;        // Количество байт в элементе
+#if !EEPROM_USE_LOG
+    static param_eeprom_t param;
+    static uint16_t slot, newStatus;
+#endif
+#if EEPROM_USE_CRC
+    static uint8_t newCrc;
+#endif
+#if EEPROM_USE_TXN
+    static uint8_t group_active = 0;    // Записывается группа транзакции
+#endif
+    volatile write_bank_t *bank = &eeprom_bank[eeprom_fill_bank ^ 1];
+
+    for (;;) {
+#if EEPROM_HAL_PAGE_SIZE
+	    // Элемент собран полностью: последняя страница записывается до того, как он станет текущим,
+	    // если следующие записи банка не могут дописать ее (EEPROM_PageDefer())
+	    if (record_active && current_byte_index >= record_bytes && eeprom_page_used
+	        && !EEPROM_PageDefer(bank->record[record_pos].index) && EEPROM_PageProgram())
 		    return;
+#endif
+#if EEPROM_USE_LOG
+	    if (record_active && current_byte_index >= record_bytes) {
+		    // Запись журнала фиксирована. После переноса записи из хвоста та же запись банка начинается заново
+		    record_active = 0;
+#if EEPROM_USE_STATS
+		    // Номер записи растет и при переносе записи из хвоста
+		    eeprom_wear_records++;
+#endif
+		    if (EEPROM_LogCommit()) {
+#if EEPROM_READ_CACHE_ACTIVE
+			    EEPROM_CacheStore(bank, bank->record[record_pos].index, bank->record[record_pos].offset);
+#endif
+			    record_pos++;
+		    }
 	    }
+#else
+	    if (record_active && current_byte_index >= record_bytes) {
+#if EEPROM_USE_TXN
+		    if (group_active) {
+			    EEPROM_TxnEnd(bank);
+			    group_active = 0;
+			    record_pos = bank->group_end;
+		    } else
+#endif
+		    {
+#if EEPROM_USE_HEAD_INDEX
+			    // Элемент записан полностью - теперь он текущий для параметра
+			    if (EEPROM_COUNTER_RING) {
+				    uint8_t index = bank->record[record_pos].index;
+				    eeprom_head_index[index].slot = slot;
+				    eeprom_head_index[index].status = newStatus;
+			    }
+#endif
+#if EEPROM_USE_STATS
+			    if (EEPROM_COUNTER_RING)
+				    eeprom_wear_records[bank->record[record_pos].index]++;
+#endif
+#if EEPROM_READ_CACHE_ACTIVE
+			    // У счетчика в банке новая база, если она записывается
+			    if (EEPROM_COUNTER_RING)
+				    EEPROM_CacheStore(bank, bank->record[record_pos].index, bank->record[record_pos].offset);
+#endif
+			    record_pos++;
+		    }
+		    record_active = 0;
+#if EEPROM_PRE_ERASE_ACTIVE
+		    pre_erase_index = 0;  // Следующий элемент этого параметра теперь не стерт
+#endif
+	    }
+#endif
 
-	    record = &eeprom_writebuffer[eeprom_writebuffer_tail];
-	    current_byte_index = 0;
-	    eeprom_writebuffer_tail = (eeprom_writebuffer_tail + 1) % MAX_WRITE_BUFFER_SIZE;
-    }
+	    if (!record_active) {
+#if EEPROM_HAL_PAGE_SIZE
+		    // Отложенная страница записывается до освобождения банка и до остановки аварийной записью
+		    if (eeprom_page_used && (record_pos >= bank->count || EEPROM_EMERGENCY_ACTIVE) && EEPROM_PageProgram())
+			    return;
+#endif
+		    if (eeprom_busy_flag && record_pos >= bank->count) {
+			    // Банк записан полностью, освобождаем его
+			    bank->count = 0;
+			    bank->used = 0;
+#if EEPROM_USE_TXN
+			    bank->group_end = 0;
+#endif
+			    record_pos = 0;
+			    // Во время транзакции заполняемый банк ждет EEPROM_Commit()
+			    if (eeprom_flush_request && eeprom_bank[eeprom_fill_bank].count && !EEPROM_TXN_OPEN) {
+				    // За время записи накопились новые записи - меняем банки и продолжаем
+				    eeprom_fill_bank ^= 1;
+				    bank = &eeprom_bank[eeprom_fill_bank ^ 1];
+			    } else {
+				    eeprom_busy_flag = 0;
+			    }
+			    eeprom_flush_request = 0;
+		    }
+
+		    if (!eeprom_busy_flag) {
+#if EEPROM_PRE_ERASE_ACTIVE
+			    // Очередь пуста - в свободное время заранее стираем следующие элементы
+			    uint16_t address;
+			    if (!EEPROM_EMERGENCY_ACTIVE && EEPROM_PreEraseNext(&address)) {
+				    EEPROM_HAL_PROGRAM_BYTE(address, 0xFF, EEPROM_HAL_ERASE_ONLY);
+				    EEPROM_STATS_ADD(pre_erase_index, programmed, 1);
+				    return;
+			    }
+#endif
+			    EEPROM_HAL_READY_IRQ_DISABLE(); // Отключаем прерывание
+			    return;
+		    }
+#if EEPROM_USE_EMERGENCY
+		    // Аварийная запись сама решает, успеет ли следующая запись
+		    if (eeprom_emergency == EEPROM_EMERGENCY_HOLD)
+			    return;
+		    if (eeprom_emergency)
+			    eeprom_emergency = EEPROM_EMERGENCY_HOLD;
+#endif
 
-    EEAR = record->adr_eeprom + current_byte_index;
-    EEDR = (current_byte_index == 0) ? record->newStatus : record->data_ptr[current_byte_index - 1];
+#if EEPROM_USE_LOG
+		    // Начинаем запись в голову журнала (или перенос живой записи из хвоста)
+		    record_bytes = EEPROM_LogBegin(bank->record[record_pos].index, &bank->data[bank->record[record_pos].offset]);
+#else
+#if EEPROM_USE_TXN
+		    if (bank->group_end && record_pos == bank->group) {
+			    // Группа транзакции записывается как один элемент
+			    record_bytes = EEPROM_TxnBegin(bank);
+			    group_active = 1;
+		    } else
+#endif
+		    {
+			    // Начинаем запись элемента: следующий за текущим элемент кольцевого буфера
+			    uint16_t status;
+			    uint8_t index = bank->record[record_pos].index;
+			    EEPROM_ReadParam(index, &param);
+			    slot = EEPROM_FindHead(index, &param, &status);
+#if EEPROM_USE_COUNTER
+			    counter_bytes = 0;
+			    counter_ring = 1;
+			    if (param.counter)
+				    EEPROM_CounterBegin(bank, bank->record[record_pos].offset, &param, slot, status);
+#endif
+			    if (++slot == param.buffer_count)
+				    slot = 0;
+			    newStatus = (status + 1) & EEPROM_SeqMask(&param);
+#if EEPROM_USE_CRC
+			    newCrc = EEPROM_CrcStatus(&param, newStatus);
+			    for (uint8_t i = 0; i < param.element_size; i++)
+				    newCrc = EEPROM_Crc8(newCrc, bank->data[bank->record[record_pos].offset + i]);
+#endif
+			    record_bytes = EEPROM_COUNTER_BYTES + (EEPROM_COUNTER_RING ? param.seq_size + param.element_size + EEPROM_CRC_SIZE : 0);
+		    }
+#endif
+		    current_byte_index = 0;
+		    record_active = 1;
+	    }
+
+	    // Параметр записываемого байта для счетчиков
+#if EEPROM_USE_LOG
+	    uint8_t owner = EEPROM_LogRecordIndex();
+	    uint16_t address;
+	    uint8_t data;
+	    EEPROM_LogByte(current_byte_index, &address, &data);
+#elif EEPROM_USE_CRC
+	    // Сначала данные и CRC, статус (младший байт первым) - последним: пока он не записан
+	    // полностью, элемент остается элементом предыдущего круга
+	    uint8_t owner = bank->record[record_pos].index;
+	    uint8_t pos = current_byte_index - EEPROM_COUNTER_BYTES;
+	    uint16_t address;
+	    uint8_t data;
+#if EEPROM_USE_TXN
+	    if (group_active) {
+		    owner = EEPROM_TxnByte(bank, current_byte_index, &address, &data);
+	    } else
+#endif
+#if EEPROM_USE_COUNTER
+	    if (current_byte_index < counter_bytes) {
+		    EEPROM_CounterByte(current_byte_index, &address, &data);
+	    } else
+#endif
+	    if (pos < param.element_size) {
+		    address = EEPROM_SlotAddress(&param, slot) + param.seq_size + pos;
+		    data = bank->data[bank->record[record_pos].offset + pos];
+	    } else if (pos == param.element_size) {
+		    address = EEPROM_SlotAddress(&param, slot) + param.seq_size + param.element_size;
+		    data = newCrc;
+	    } else {
+		    uint8_t i = pos - param.element_size - 1;
+		    address = EEPROM_SlotAddress(&param, slot) + i;
+		    data = (uint8_t)(newStatus >> (8 * i));
+	    }
+#else
+	    // Сначала байты статуса (младший первым), затем данные
+	    uint8_t owner = bank->record[record_pos].index;
+	    uint8_t pos = current_byte_index - EEPROM_COUNTER_BYTES;
+	    uint16_t address;
+	    uint8_t data;
+#if EEPROM_USE_COUNTER
+	    if (current_byte_index < counter_bytes) {
+		    EEPROM_CounterByte(current_byte_index, &address, &data);
+	    } else
+#endif
+	    {
+		    address = EEPROM_SlotAddress(&param, slot) + pos;
+		    data = (pos < param.seq_size) ? (uint8_t)(newStatus >> (8 * pos))
+		                                  : bank->data[bank->record[record_pos].offset + pos - param.seq_size];
+	    }
+#endif
+
+#if EEPROM_HAL_PAGE_SIZE
+	    // Байт другой страницы - сначала записываем собранные, этот байт будет вычислен заново
+	    if (eeprom_page_used && (uint16_t)(address - eeprom_page_base) >= EEPROM_HAL_PAGE_SIZE && EEPROM_PageProgram())
+		    return;
+	    EEPROM_PageAdd(address, data, owner);
+	    current_byte_index++;
+#else
+	    current_byte_index++;
 
-    EECR |= (1 << EEMWE);
-    EECR |= (1 << EEWE);
-    
-    current_byte_index++;
+	    // Если байт совпадает с записанным - сразу переходим к следующему
+	    if (EEPROM_ProgramByte(address, data)) {
+		    // Байты журнала транзакций не относятся к параметрам
+		    if (owner < PARAM_COUNT)
+			    EEPROM_STATS_ADD(owner, programmed, 1);
+		    return;
+	    }
+#endif
     }
+}
+
+// Вектор прерывания "EEPROM Ready" для Atmega128
+EEPROM_HAL_READY_ISR(){
+#if EEPROM_USE_STATS
+	uint16_t start = EEPROM_HAL_CYCLES();
+	EEPROM_Ready();
+	uint16_t cycles = EEPROM_HAL_CYCLES() - start;
+	eeprom_stats.isr_calls++;
+	eeprom_stats.isr_cycles += cycles;
+	if (cycles > eeprom_stats.isr_cycles_max)
+		eeprom_stats.isr_cycles_max = cycles;
+#else
+	EEPROM_Ready();
+#endif
+}
+
+#if EEPROM_USE_EMERGENCY
+// Ожидание готовности EEPROM опросом. Время копится приращениями 16-битного счетчика тактов,
+// который не успевает переполниться между опросами
+static void EEPROM_EmergencyWait(uint32_t *cycles, uint16_t *last) {
+	do {
+		uint16_t now = EEPROM_HAL_CYCLES();
+		*cycles += (uint16_t)(now - *last);
+		*last = now;
+	} while (EEPROM_HAL_BUSY());
+}
+
+// Запись банка опросом вместо прерывания, пока обработчик не остановится без начала программирования.
+// Время каждого цикла программирования уточняет eeprom_program_us
+static void EEPROM_EmergencyRun(uint32_t *cycles, uint16_t *last) {
+	for (;;) {
+		EEPROM_Ready();
+		if (!EEPROM_HAL_BUSY())
+			return;
+		uint32_t start = *cycles;
+		EEPROM_EmergencyWait(cycles, last);
+		uint32_t program_us = (*cycles - start) / EEPROM_HAL_CYCLES_PER_US;
+		if (program_us > eeprom_program_us)
+			eeprom_program_us = program_us > 0xFFFF ? 0xFFFF : (uint16_t)program_us;
+	}
+}
+
+// Наибольшее количество циклов программирования записи банка: каждый байт элемента (во внешней
+// EEPROM - страница элемента), у счетчика - и область приращений
+static uint16_t EEPROM_EmergencyPrograms(const param_eeprom_t *param) {
+#if EEPROM_USE_LOG
+	// Запись журнала и перенос живой записи из хвоста
+	(void)param;
+	return EEPROM_HAL_PAGE_SIZE ? 2 : 2 * EEPROM_LOG_RECORD_SIZE;
+#elif EEPROM_HAL_PAGE_SIZE
+	return 1 + (param->counter ? param->counter / EEPROM_HAL_PAGE_SIZE + 2 : 0);
+#else
+	return param->seq_size + param->element_size + EEPROM_CRC_SIZE + param->counter;
+#endif
+}
+
+// Запись не будет записана: с кэшем значение снова ждет записи, счетчик теряет приращения
+static void EEPROM_EmergencyDrop(eeprom_emergency_report_t *report, const param_eeprom_t *param,
+                                 const uint8_t index, const volatile uint8_t *data) {
+#if EEPROM_USE_COUNTER
+	if (param->counter && data != NULL)
+		eeprom_counter[index] -= data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+#else
+	(void)param;
+	(void)data;
+#endif
+#if EEPROM_USE_SHADOW
+	eeprom_shadow_dirty[index >> 3] |= 1 << (index & 7);
+#endif
+	EEPROM_STATS_ADD(index, dropped, 1);
+	if (report->dropped < sizeof(report->dropped_index))
+		report->dropped_index[report->dropped] = index;
+	report->dropped++;
+}
+
+uint8_t EEPROM_EmergencyFlush(const uint16_t budget_us, eeprom_emergency_report_t *report) {
+	emergency_record_t *pending = emergency_pending;
+	uint8_t *data = emergency_data;
+	eeprom_emergency_report_t *result = &emergency_result;
+	uint8_t count = 0, used = 0;
+	param_eeprom_t param;
+	uint32_t cycles = 0;
+	uint16_t last = EEPROM_HAL_CYCLES();
+
+	memset(result, 0, sizeof(*result));
+	EEPROM_HAL_READY_IRQ_DISABLE();
+	eeprom_emergency = EEPROM_EMERGENCY_HOLD;
+
+	// Начатый элемент дописывается: без CRC прерванный элемент стал бы испорченным текущим
+	EEPROM_EmergencyWait(&cycles, &last);
+	EEPROM_EmergencyRun(&cycles, &last);
+
+#if EEPROM_USE_SHADOW
+	// Незаписанные значения кэша - в буфер записи, не поместившиеся остаются в кэше
+	for (uint8_t index = 0; index < PARAM_COUNT; index++) {
+		if (EEPROM_ShadowIsDirty(index) && !EEPROM_ShadowQueue(index)) {
+			EEPROM_ReadParam(index, &param);
+			EEPROM_EmergencyDrop(result, &param, index, NULL);
+		}
+	}
+#endif
+
+	// Ожидающие записи обоих банков, более старое значение того же параметра не нужно
+	for (uint8_t b = eeprom_busy_flag ? 0 : 1; b < 2; b++) {
+		volatile write_bank_t *bank = &eeprom_bank[eeprom_fill_bank ^ 1 ^ b];
+		for (uint8_t i = b ? 0 : record_pos; i < bank->count; i++) {
+			uint8_t index = bank->record[i].index;
+			EEPROM_ReadParam(index, &param);
+			if (!b && !param.counter && eeprom_bank_find(&eeprom_bank[eeprom_fill_bank], index, 0) != MAX_WRITE_BUFFER_SIZE)
+				continue;
+			pending[count].index = index;
+			pending[count].priority = param.priority;
+			pending[count].size = param.counter ? 4 : param.element_size;
+			pending[count].offset = used;
+			for (uint8_t j = 0; j < pending[count].size; j++)
+				data[used++] = bank->data[bank->record[i].offset + j];
+			count++;
+		}
+	}
+
+	// По убыванию приоритета, с равным приоритетом - в порядке записи
+	for (uint8_t i = 1; i < count; i++) {
+		emergency_record_t record = pending[i];
+		uint8_t j = i;
+		for (; j > 0 && pending[j - 1].priority < record.priority; j--)
+			pending[j] = pending[j - 1];
+		pending[j] = record;
+	}
+
+	// Банки заполняются заново в этом порядке: сначала записываемый, затем заполняемый
+	for (uint8_t b = 0; b < 2; b++) {
+		eeprom_bank[b].count = 0;
+		eeprom_bank[b].used = 0;
+	}
+	record_pos = 0;
+	for (uint8_t i = 0, b = 1; i < count; i++) {
+		if (b && !eeprom_bank_append(&eeprom_bank[eeprom_fill_bank ^ 1], pending[i].index, &data[pending[i].offset], pending[i].size))
+			b = 0;
+		if (!b && !eeprom_bank_append(&eeprom_bank[eeprom_fill_bank], pending[i].index, &data[pending[i].offset], pending[i].size)) {
+			EEPROM_ReadParam(pending[i].index, &param);
+			EEPROM_EmergencyDrop(result, &param, pending[i].index, &data[pending[i].offset]);
+		}
+	}
+	eeprom_busy_flag = eeprom_bank[eeprom_fill_bank ^ 1].count != 0;
+	eeprom_flush_request = eeprom_bank[eeprom_fill_bank].count != 0;
+
+	// Запись начинается, только если успевает по наихудшей оценке. Обработчик в режиме ожидания
+	// освобождает записанный банк и переходит к следующему, не начиная записи
+	for (uint8_t restart = 0;;) {
+		EEPROM_Ready();
+		if (!eeprom_busy_flag)
+			break;
+		uint8_t flush = eeprom_fill_bank ^ 1, pos = record_pos;
+		volatile write_bank_t *bank = &eeprom_bank[flush];
+		uint8_t index = bank->record[pos].index;
+		EEPROM_ReadParam(index, &param);
+		// Оценка журнала включает перенос записи из хвоста, после переноса осталась сама запись
+		uint32_t programs = EEPROM_EmergencyPrograms(&param) >> restart;
+		if (cycles / EEPROM_HAL_CYCLES_PER_US + programs * eeprom_program_us > budget_us) {
+			EEPROM_EmergencyDrop(result, &param, index, &bank->data[bank->record[pos].offset]);
+			for (uint8_t i = pos; i + 1 < bank->count; i++)
+				bank->record[i] = bank->record[i + 1];
+			bank->count--;
+			restart = 0;
+			continue;
+		}
+		eeprom_emergency = EEPROM_EMERGENCY_NEXT;
+		EEPROM_EmergencyRun(&cycles, &last);
+		// После переноса записи из хвоста журнала та же запись банка начинается заново
+		restart = eeprom_busy_flag && (eeprom_fill_bank ^ 1) == flush && record_pos == pos;
+		if (!restart)
+			result->written++;
+	}
+	eeprom_emergency = EEPROM_EMERGENCY_OFF;
+
+	EEPROM_EmergencyWait(&cycles, &last);
+	result->elapsed_us = cycles / EEPROM_HAL_CYCLES_PER_US > 0xFFFF ? 0xFFFF : (uint16_t)(cycles / EEPROM_HAL_CYCLES_PER_US);
+	result->program_us = eeprom_program_us;
+	if (report != NULL)
+		*report = *result;
+	return result->dropped;
+}
+#endif
+
+#if EEPROM_USE_STATS
+void EEPROM_GetParamStats(const uint8_t index, eeprom_param_stats_t *stats) {
+	EEPROM_HAL_ATOMIC_BLOCK() {
+		*stats = eeprom_param_stats[index];
+	}
+}
+
+void EEPROM_GetStats(eeprom_stats_t *stats) {
+	EEPROM_HAL_ATOMIC_BLOCK() {
+		*stats = eeprom_stats;
+	}
+}
+
+void EEPROM_ResetStats(void) {
+	const eeprom_param_stats_t param_zero = {0};
+	const eeprom_stats_t zero = {0};
+
+	EEPROM_HAL_ATOMIC_BLOCK() {
+		for (uint8_t index = 0; index < PARAM_COUNT; index++)
+			eeprom_param_stats[index] = param_zero;
+		eeprom_stats = zero;
+	}
+}
+
+// Количество записей элемента по номеру записи. Всего записано total записей, известны total по модулю
+// modulus (по статусу) и по модулю count (по номеру текущего элемента - head_rest). Ищется наименьшее
+// total = total_mod + k * modulus с нужным остатком, элементу достаются записи first, first + count, ...
+// Статусы и номер элемента повторяются через НОК(modulus, count) записей: если с запуска записано
+// больше (written), оценка увеличивается на целое число таких периодов и становится нижней границей
+static uint32_t EEPROM_SlotRecords(uint32_t total_mod, const uint32_t modulus, const uint16_t head_rest,
+                                   const uint16_t count, const uint16_t first, const uint32_t written,
+                                   uint8_t *lower_bound) {
+	uint32_t total = total_mod;
+	uint16_t rest = total % count;
+	uint16_t step = modulus % count;
+	uint32_t a = modulus, b = count;
+
+	for (uint16_t k = 0; rest != head_rest && k < count; k++) {
+		rest = (uint16_t)(((uint32_t)rest + step) % count);
+		total += modulus;
+	}
+	// Решения нет, если EEPROM не была чистой при первой записи - остается оценка по статусу
+	if (rest != head_rest)
+		total = total_mod;
+
+	while (b) {
+		uint32_t t = a % b;
+		a = b;
+		b = t;
+	}
+	uint32_t period = modulus / a * count;
+	if (total < written) {
+		uint32_t laps = (written - total + period - 1) / period;
+		total = (laps > (0xFFFFFFFFUL - total) / period) ? 0xFFFFFFFFUL : total + laps * period;
+	}
+	if (lower_bound != NULL)
+		*lower_bound = total >= period;
+	return (total > first) ? (total - 1 - first) / count + 1 : 0;
+}
+
+uint32_t EEPROM_EstimateWear(const uint8_t index, const uint16_t slot, uint8_t *lower_bound) {
+	uint32_t written;
+
+	if (lower_bound != NULL)
+		*lower_bound = 0;
+#if EEPROM_USE_LOG
+	// Журнал общий для всех параметров. На чистой EEPROM запись j идет в элемент j % slots с номером j
+	uint16_t seq, slots;
+
+	(void)index;
+	if (!eeprom_mounted)
+		EEPROM_Mount();
+	// Счетчик - до текущего элемента: записанный между ними элемент не должен выглядеть полным периодом
+	EEPROM_HAL_ATOMIC_BLOCK() {
+		written = eeprom_wear_records;
+	}
+	uint16_t head = EEPROM_LogHead(&seq, &slots);
+	if (slot >= slots)
+		return 0;
+	return EEPROM_SlotRecords((uint16_t)(seq + 1), 0x10000UL, (head + 1) % slots, slots, slot, written, lower_bound);
+#else
+	param_eeprom_t param;
+	uint16_t status;
+
+	EEPROM_ReadParam(index, &param);
+	if (slot >= param.buffer_count)
+		return 0;
+	// На чистой EEPROM текущий элемент 0 со статусом 0xFF(FF), запись j идет в элемент (j + 1) % buffer_count
+	// со статусом j: после total записей текущий элемент total % buffer_count, статус total - 1
+	EEPROM_HAL_ATOMIC_BLOCK() {
+		written = eeprom_wear_records[index];
+	}
+	uint16_t head = EEPROM_FindHead(index, &param, &status);
+	return EEPROM_SlotRecords((status + 1) & EEPROM_SeqMask(&param), (uint32_t)EEPROM_SeqMask(&param) + 1, head,
+	                          param.buffer_count, (slot + param.buffer_count - 1) % param.buffer_count,
+	                          written, lower_bound);
+#endif
+}
+#endif
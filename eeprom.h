@@ -49,11 +49,289 @@ enum {
 	EE_BAT_MIN_V,
 };
 
-// Максимальный размер буфера для отложенной записи в EEPROM
-#define MAX_WRITE_BUFFER_SIZE 10  
+// Максимальное количество параметров в одном банке буфера отложенной записи в EEPROM
+#ifndef MAX_WRITE_BUFFER_SIZE
+#define MAX_WRITE_BUFFER_SIZE 10
+#endif
+
+// Размер арены (в байтах) под копии данных в одном банке буфера. Банков два:
+// пока один записывается в EEPROM, в другой добавляются новые записи
+#ifndef EEPROM_WRITE_ARENA_SIZE
+#define EEPROM_WRITE_ARENA_SIZE 32
+#endif
+
+// Хранить в ОЗУ таблицу текущих элементов кольцевых буферов (по 4 байта на параметр).
+// Для МК с очень малым объемом ОЗУ можно отключить (0), тогда поиск текущего
+// элемента выполняется по EEPROM при каждом обращении.
+#ifndef EEPROM_USE_HEAD_INDEX
+#define EEPROM_USE_HEAD_INDEX 1
+#endif
+
+// Бюджет ОЗУ (в байтах) под таблицу текущих элементов. При превышении - ошибка компиляции.
+#ifndef EEPROM_HEAD_INDEX_RAM_BUDGET
+#define EEPROM_HEAD_INDEX_RAM_BUDGET 64
+#endif
+
+// Хранить в ОЗУ копию значений всех параметров (EEPROM_DATA_SIZE байт и по 2 байта на параметр),
+// обновляется в прерывании после записи элемента. Чтение тогда не обращается к EEPROM и не ждет
+// окончания программирования. При отключении (0) чтение параметра, которого нет в буфере записи,
+// ждет окончания записи текущего байта EEPROM. С EEPROM_USE_SHADOW не используется (значения в кэше).
+// В таблице из eeprom.hpp по умолчанию включена, если при сборке задан EEPROM_DATA_SIZE.
+#ifndef EEPROM_USE_READ_CACHE
+#if defined(EEPROM_PARAM_COUNT) && !defined(EEPROM_DATA_SIZE)
+#define EEPROM_USE_READ_CACHE 0
+#else
+#define EEPROM_USE_READ_CACHE 1
+#endif
+#endif
+
+// Бюджет ОЗУ (в байтах) под копию значений. При превышении - ошибка компиляции.
+#ifndef EEPROM_READ_CACHE_RAM_BUDGET
+#define EEPROM_READ_CACHE_RAM_BUDGET 64
+#endif
+
+// Заранее стирать (0xFF) данные следующего элемента каждого параметра в свободное время,
+// чтобы запись данных выполнялась быстрым циклом "только запись" (~1.8 мс вместо ~3.4 мс).
+// Действует на МК с раздельными стиранием и записью (биты EEPM), на остальных игнорируется.
+#ifndef EEPROM_PRE_ERASE
+#define EEPROM_PRE_ERASE 0
+#endif
+
+// Кэш значений всех параметров в ОЗУ с отложенной записью: чтение всегда из ОЗУ,
+// запись в EEPROM - после затишья параметра (QUIET в таблице параметров),
+// по достижении EEPROM_SHADOW_MAX_AGE или по EEPROM_Flush(). Требует вызова EEPROM_Tick().
+#ifndef EEPROM_USE_SHADOW
+#define EEPROM_USE_SHADOW 0
+#endif
+
+// Максимальный возраст незаписанного изменения в кэше (в тиках EEPROM_Tick()).
+// Параметр, который меняется непрерывно, все равно будет записан по истечении этого времени
+#ifndef EEPROM_SHADOW_MAX_AGE
+#define EEPROM_SHADOW_MAX_AGE 600
+#endif
+
+// Ограничитель износа: ресурс кольцевого буфера (COUNT элементов x EEPROM_GOVERNOR_ENDURANCE циклов)
+// распределяется на срок службы EEPROM_GOVERNOR_LIFETIME_DAYS, и параметр передается из кэша в буфер
+// записи не чаще, чем раз в полученный интервал (подряд - до EEPROM_GOVERNOR_BURST раз). Более частые
+// изменения ждут в кэше, записывается последнее значение. Время считается тиками EEPROM_Tick() с периодом
+// EEPROM_GOVERNOR_TICK_MS. Бюджет хранится в ОЗУ и после сброса пуст: EEPROM_Mount() считает его
+// израсходованным, первая запись - через интервал, полный запас - через EEPROM_GOVERNOR_BURST интервалов.
+// Бюджет тратит только новая запись в буфере: значение, совпавшее с EEPROM или слитое с ожидающей
+// записью, его не расходует. EEPROM_Flush() значения без бюджета не записывает, EEPROM_ForceFlush()
+// записывает их в долг. Счетчики и EEPROM_EmergencyFlush() не ограничиваются. По 4 байта ОЗУ на параметр.
+// Требует EEPROM_USE_SHADOW, не используется с журналом EEPROM_USE_LOG.
+#ifndef EEPROM_USE_GOVERNOR
+#define EEPROM_USE_GOVERNOR 0
+#endif
+
+// Требуемый срок службы, суток
+#ifndef EEPROM_GOVERNOR_LIFETIME_DAYS
+#define EEPROM_GOVERNOR_LIFETIME_DAYS 3650UL
+#endif
+
+// Ресурс ячейки EEPROM по документации, циклов стирания/записи
+#ifndef EEPROM_GOVERNOR_ENDURANCE
+#define EEPROM_GOVERNOR_ENDURANCE 100000UL
+#endif
+
+// Период вызова EEPROM_Tick(), мс
+#ifndef EEPROM_GOVERNOR_TICK_MS
+#define EEPROM_GOVERNOR_TICK_MS 100UL
+#endif
+
+// Сколько записей параметра разрешено подряд после долгого затишья
+#ifndef EEPROM_GOVERNOR_BURST
+#define EEPROM_GOVERNOR_BURST 4
+#endif
+
+// Формат элемента с контрольной суммой: [статус][данные][CRC-8 статуса и данных].
+// Статус записывается последним, поэтому элемент, запись которого прервана сбросом,
+// остается элементом предыдущего круга. Меняет размещение параметров в EEPROM (EEPROM_CRC_SIZE).
+#ifndef EEPROM_USE_CRC
+#define EEPROM_USE_CRC 0
+#endif
+
+// Восстановление при монтировании: EEPROM_Mount() один раз последовательно проверяет все элементы
+// всех кольцевых буферов, откатывается к последнему элементу с верной CRC и исправляет статусы
+// прерванных элементов. Текущие элементы для таблицы в ОЗУ находятся этим же проходом. Требует EEPROM_USE_CRC.
+#ifndef EEPROM_RECOVERY
+#define EEPROM_RECOVERY EEPROM_USE_CRC
+#endif
+
+// Транзакции: параметры, записанные между EEPROM_BeginTransaction() и EEPROM_Commit(), записываются
+// группой и становятся видимыми все сразу по одной отметке в журнале транзакций (EEPROM_TXN_SLOTS записей
+// перед EEPROM_START_ADR). Группа, прерванная сбросом до отметки, откатывается при монтировании, после
+// отметки - дописывается. Требует EEPROM_RECOVERY, не используется с кэшем и с журналом EEPROM_USE_LOG.
+#ifndef EEPROM_USE_TXN
+#define EEPROM_USE_TXN 0
+#endif
+
+// Максимальное количество разных параметров в группе
+#ifndef EEPROM_TXN_MAX_PARAMS
+#define EEPROM_TXN_MAX_PARAMS 4
+#endif
+
+// Количество записей журнала транзакций (записи используются по кругу для распределения износа, не более 127)
+#ifndef EEPROM_TXN_SLOTS
+#define EEPROM_TXN_SLOTS 4
+#endif
+
+// Запись журнала транзакций: [номер][количество][индекс, элемент (2 байта), статус (2 байта)] x EEPROM_TXN_MAX_PARAMS [CRC][отметка]
+#define EEPROM_TXN_ENTRY_SIZE (2 + 5 * EEPROM_TXN_MAX_PARAMS + 2)
+// Журнал транзакций занимает столько байт перед EEPROM_START_ADR
+#define EEPROM_TXN_AREA_SIZE (EEPROM_USE_TXN ? EEPROM_RING_BYTES(EEPROM_TXN_ENTRY_SIZE, EEPROM_TXN_SLOTS) : 0)
+
+// Счетчики работы библиотеки: по параметрам (запросы записи, пропущенные и отброшенные записи,
+// запрограммированные байты), глубина буфера записи, время в прерывании и в поиске текущего элемента
+// (такты EEPROM_HAL_CYCLES()), оценка износа элементов по статусам. По 10 байт ОЗУ на параметр.
+#ifndef EEPROM_USE_STATS
+#define EEPROM_USE_STATS 0
+#endif
+
+// Счетчики (моточасы, количество циклов): параметр с ненулевым COUNTER в таблице хранит в кольцевом буфере
+// базу (uint32_t), а приращения - единичным кодом в двух стертых областях по COUNTER байт за буфером:
+// каждое приращение сбрасывает следующий бит активной области (цикл "только запись" без стирания).
+// Значение = база + количество сброшенных битов. Когда область заполнена, сумма записывается в буфер
+// новой базой, и активной становится другая, заранее стертая область (по четности статуса базы).
+// По 4 байта ОЗУ на параметр. Не используется с журналом EEPROM_USE_LOG и с транзакциями.
+#ifndef EEPROM_USE_COUNTER
+#define EEPROM_USE_COUNTER 0
+#endif
+
+// Аварийная запись при пропадании питания (EEPROM_EmergencyFlush()): буфер записи переписывается
+// по приоритетам параметров (PRIORITY в таблице) за заданное время удержания питания, прерывание
+// готовности не используется. Время оценивается тактами EEPROM_HAL_CYCLES(), как в EEPROM_USE_STATS.
+// Не используется с транзакциями: перестановка записей разбила бы группы.
+#ifndef EEPROM_USE_EMERGENCY
+#define EEPROM_USE_EMERGENCY 0
+#endif
+
+// Время программирования по документации (байта встроенной EEPROM или страницы внешней), мкс.
+// Аварийная запись считает по большему из него и измеренного времени (при низком напряжении - дольше)
+#ifndef EEPROM_EMERGENCY_PROGRAM_US
+#define EEPROM_EMERGENCY_PROGRAM_US (EEPROM_HAL_PAGE_SIZE ? 5000 : 3400)
+#endif
+
+// Журнал в общей области EEPROM вместо отдельного кольцевого буфера на каждый параметр (eeprom_log.c):
+// все параметры дописывают записи в один кольцевой журнал от EEPROM_START_ADR до EEPROM_SIZE,
+// живые записи редко меняющихся параметров переносятся вперед в фоне. _COUNT и _ADDR таблицы не используются.
+#ifndef EEPROM_USE_LOG
+#define EEPROM_USE_LOG 0
+#endif
+
+// Место под данные в записи журнала (наибольший размер параметра). Таблица с параметром большего размера
+// не компилируется (error_eeprom_log_value)
+#ifndef EEPROM_LOG_VALUE_SIZE
+#define EEPROM_LOG_VALUE_SIZE 4
+#endif
+
+// Максимальное количество параметров в журнале (по 2 байта ОЗУ на параметр)
+#ifndef EEPROM_LOG_MAX_PARAMS
+#define EEPROM_LOG_MAX_PARAMS 16
+#endif
+
+// Размер записи журнала: номер записи (2 байта), индекс параметра, данные, CRC
+#define EEPROM_LOG_RECORD_SIZE (2 + 1 + EEPROM_LOG_VALUE_SIZE + 1)
+
+#if EEPROM_USE_LOG
+// У журнала свои CRC, таблица последних записей и восстановление, настройки кольцевых буферов не действуют
+#undef EEPROM_USE_HEAD_INDEX
+#define EEPROM_USE_HEAD_INDEX 0
+#undef EEPROM_USE_CRC
+#define EEPROM_USE_CRC 0
+#undef EEPROM_RECOVERY
+#define EEPROM_RECOVERY 0
+#undef EEPROM_PRE_ERASE
+#define EEPROM_PRE_ERASE 0
+#endif
+
+// Размер CRC в элементе кольцевого буфера (учитывается в таблице параметров)
+#define EEPROM_CRC_SIZE (EEPROM_USE_CRC ? 1 : 0)
+
+// Размещение элементов размером stride байт (кольцевые буферы, журнал): место под count элементов,
+// количество элементов в области size байт и адрес элемента slot области с адреса base.
+// Во внешней EEPROM со страничной записью (EEPROM_HAL_PAGE_SIZE, задается при сборке) элемент не
+// пересекает границу страницы: на странице помещается EEPROM_HAL_PAGE_SIZE / stride элементов,
+// остаток страницы не используется, а каждая область начинается с новой страницы (EEPROM_PAGE_ALIGN).
+// Элемент больше страницы - ошибка компиляции таблицы (деление на 0)
+#if EEPROM_HAL_PAGE_SIZE
+#define EEPROM_PAGE_SLOTS(stride) (EEPROM_HAL_PAGE_SIZE / (stride))
+#define EEPROM_PAGE_ALIGN(address) (((address) + EEPROM_HAL_PAGE_SIZE - 1) / EEPROM_HAL_PAGE_SIZE * EEPROM_HAL_PAGE_SIZE)
+#define EEPROM_RING_BYTES(stride, count) \
+	(((count) + EEPROM_PAGE_SLOTS(stride) - 1) / EEPROM_PAGE_SLOTS(stride) * EEPROM_HAL_PAGE_SIZE)
+#define EEPROM_RING_SLOTS(size, stride) ((size) / EEPROM_HAL_PAGE_SIZE * EEPROM_PAGE_SLOTS(stride))
+#define EEPROM_RING_ADDRESS(base, stride, slot) \
+	((base) + (slot) / EEPROM_PAGE_SLOTS(stride) * EEPROM_HAL_PAGE_SIZE + (slot) % EEPROM_PAGE_SLOTS(stride) * (stride))
+#else
+#define EEPROM_PAGE_ALIGN(address) (address)
+#define EEPROM_RING_BYTES(stride, count) ((stride) * (count))
+#define EEPROM_RING_SLOTS(size, stride) ((size) / (stride))
+#define EEPROM_RING_ADDRESS(base, stride, slot) ((base) + (slot) * (stride))
+#endif
 
 #include <stdint.h>
+#if defined(__AVR__)
 #include <avr/io.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Описание параметра в таблице param_eeprom (PROGMEM)
+typedef struct {
+	uint8_t element_size;  // Размер данных (без учета счетчика)
+	uint8_t seq_size;      // Размер счетчика (статуса) элемента: 1 или 2 байта
+	uint16_t buffer_count; // Количество элементов в буфере (не более 255 для 1-байтового счетчика)
+	uint16_t addr;         // Начальный адрес в EEPROM
+	uint8_t quiet;         // Затишье (в тиках EEPROM_Tick()), после которого значение из кэша записывается в EEPROM
+	uint8_t counter;       // Счетчик: размер каждой из двух областей приращений в байтах (0 - обычный параметр)
+	uint8_t priority;      // Приоритет при аварийной записи (EEPROM_EmergencyFlush()), больше - важнее
+} param_eeprom_t;
+
+#ifdef EEPROM_PARAM_COUNT
+// Таблица параметров, заданная в приложении (EEPROM_DEFINE_LAYOUT() из eeprom.hpp) вместо таблицы в eeprom.c.
+// EEPROM_PARAM_COUNT (и EEPROM_DATA_SIZE для кэша и копии значений) задаются при сборке, eeprom.hpp проверяет их
+// при компиляции
+typedef struct {
+	uint16_t size;   // Размер EEPROM (EEPROM_SIZE)
+	uint16_t start;  // Начальный адрес (EEPROM_START_ADR)
+	param_eeprom_t param[EEPROM_PARAM_COUNT];
+} eeprom_layout_t;
+#endif
+
+/**
+ * @brief Монтирует EEPROM: однократно сканирует кольцевые буферы всех параметров.
+ *
+ * Находит текущий элемент каждого параметра и сохраняет его номер и статус
+ * в таблице в ОЗУ, после чего чтение и запись не обращаются к EEPROM для поиска.
+ * При `EEPROM_USE_SHADOW` или `EEPROM_USE_READ_CACHE` также загружает значения
+ * всех параметров в ОЗУ.
+ * При `EEPROM_RECOVERY` проверяет CRC всех элементов, откатывает параметры к
+ * последнему целому элементу и исправляет статусы (блокирующая запись EEPROM).
+ * Вызывается один раз при старте до обращения к параметрам и до начала записи.
+ * Если вызов пропущен, монтирование выполняется автоматически при первом обращении.
+ * Без таблицы, кэша и восстановления функция ничего не делает.
+ */
+void EEPROM_Mount(void);
+
+#if EEPROM_RECOVERY
+/**
+ * @brief Возвращает количество статусов, исправленных при последнем монтировании.
+ *
+ * Ненулевое значение означает, что запись элемента была прервана (сброс,
+ * пропадание питания) или элемент испорчен, и параметр откатился к последнему
+ * целому значению.
+ */
+uint16_t EEPROM_GetRepairCount(void);
+#endif
+
+/**
+ * @brief Возвращает объем ОЗУ (в байтах), занятый библиотекой.
+ *
+ * Учитывает буфер отложенной записи, таблицу текущих элементов и кэш значений.
+ */
+uint16_t EEPROM_GetRamUsage(void);
 
 /**
  * @brief Читает один байт из EEPROM с учетом износа памяти.
@@ -82,6 +360,11 @@ uint16_t EEPROM_ReadWearLeveledWord(const uint8_t index);
  *
  * Производит поиск актуального значения переменной по заданному индексу,  
  * считывает ее из EEPROM и записывает в переданный буфер.  
+ * Значение, которое еще ждет записи в буфере, возвращается из буфера.
+ * С копией значений в ОЗУ (`EEPROM_USE_READ_CACHE`, по умолчанию) или кэшем
+ * (`EEPROM_USE_SHADOW`) EEPROM не читается и окончание записи не ожидается.
+ * Без них чтение ждет окончания программирования текущего байта EEPROM
+ * (см. `EEPROM_TryReadWearLeveledBlock()`).
  *
  * @param index Индекс параметра в EEPROM.  
  * @param ptr   Указатель на буфер, куда будет записано считанное значение.  
@@ -100,29 +383,320 @@ void EEPROM_ReadWearLeveledBlock(const uint8_t index, void *ptr, uint8_t size);
 #define EEPROM_ReadWearLeveled(index, ptr) \
     EEPROM_ReadWearLeveledBlock(index, (void*)(&ptr), sizeof(ptr))
 
+/**
+ * @brief Читает данные параметра без ожидания окончания записи EEPROM.
+ *
+ * Значение, ожидающее записи или записываемое в данный момент, возвращается из
+ * буфера записи (это же делают и функции чтения выше). К EEPROM функция обращается
+ * только если параметра в буфере нет, и только когда EEPROM не занята программированием:
+ * иначе возвращает 0 и не изменяет буфер `ptr`. Подходит для чтения настроек в каждом
+ * такте цикла управления: при 0 используется прошлое значение. С копией значений
+ * (`EEPROM_USE_READ_CACHE`) или кэшем (`EEPROM_USE_SHADOW`) чтение всегда из ОЗУ
+ * и функция всегда возвращает 1.
+ *
+ * @param index Индекс параметра в EEPROM.
+ * @param ptr   Указатель на буфер, куда будет записано считанное значение.
+ * @param size  Размер данных для чтения (в байтах).
+ * @return 1 - значение прочитано, 0 - EEPROM занята, повторите позже.
+ */
+uint8_t EEPROM_TryReadWearLeveledBlock(const uint8_t index, void *ptr, uint8_t size);
+
+// То же, что `EEPROM_ReadWearLeveled()`, без ожидания окончания записи EEPROM
+#define EEPROM_TryReadWearLeveled(index, ptr) \
+    EEPROM_TryReadWearLeveledBlock(index, (void*)(&ptr), sizeof(ptr))
+
+/**
+ * @brief Читает значение параметра по переданному описанию, без чтения таблицы из flash.
+ *
+ * Используется шаблонами eeprom.hpp, в которых описание параметра - константа
+ * времени компиляции. Размер не проверяется: `size` не должен превышать
+ * `param->element_size`.
+ *
+ * @param index Индекс параметра в EEPROM.
+ * @param param Описание параметра (совпадает с param_eeprom[index]).
+ * @param ptr   Указатель на буфер для значения.
+ * @param size  Размер данных для чтения (в байтах).
+ */
+void EEPROM_ReadParamValue(const uint8_t index, const param_eeprom_t *param, void *ptr, const uint8_t size);
+
+/**
+ * @brief То же, что `EEPROM_ReadParamValue()`, без ожидания окончания записи EEPROM
+ *        (см. `EEPROM_TryReadWearLeveledBlock()`).
+ *
+ * @return 1 - значение прочитано, 0 - EEPROM занята, `ptr` не изменен.
+ */
+uint8_t EEPROM_TryReadParamValue(const uint8_t index, const param_eeprom_t *param, void *ptr, const uint8_t size);
+
 /**
  * @brief Добавляет данные в буфер записи EEPROM с учетом износа памяти.
  *
- * Данная функция вносит ссылку на переменную в буфер записи. Запись в EEPROM 
- * осуществляется асинхронно после вызова `StartWriteBuffer()`.
+ * Данная функция копирует значение переменной в буфер записи, после вызова
+ * переменную можно свободно изменять. Запись в EEPROM осуществляется
+ * асинхронно после вызова `StartWriteBuffer()`.
  *
- * ВНИМАНИЕ:  
- * - Одновременно нельзя изменять одну и ту же переменную, иначе все изменения 
- *   запишутся в одну ячейку памяти, что приведет к ускоренному износу.  
- * - Максимальное количество переменных в буфере ограничено `MAX_WRITE_BUFFER_SIZE`.  
+ * - Повторная запись параметра, еще не переданного в EEPROM, заменяет данные
+ *   в буфере (записывается последнее значение).
+ * - Значение, совпадающее с последним записанным, не добавляется.
+ * - Во время записи в EEPROM новые данные добавляются во второй банк буфера.
+ * - В банке помещается не более `MAX_WRITE_BUFFER_SIZE` параметров общим
+ *   размером до `EEPROM_WRITE_ARENA_SIZE` байт, при переполнении запись отбрасывается.
  *
  * @param index Индекс параметра в EEPROM.
  * @param data  Указатель на данные для записи.
  */
 void EEPROM_WriteWearLeveled(const uint8_t index, const void *data);
 
+/**
+ * @brief То же, что `EEPROM_WriteWearLeveled()`, с описанием параметра, переданным напрямую.
+ *
+ * Используется шаблонами eeprom.hpp. Записывается `param->element_size` байт из `data`.
+ *
+ * @param index Индекс параметра в EEPROM.
+ * @param param Описание параметра (совпадает с param_eeprom[index]).
+ * @param data  Указатель на данные для записи.
+ */
+void EEPROM_WriteParamValue(const uint8_t index, const param_eeprom_t *param, const void *data);
+
+#if EEPROM_USE_COUNTER
+/**
+ * @brief Добавляет приращение счетчика в буфер записи.
+ *
+ * Значение счетчика в ОЗУ увеличивается сразу, в EEPROM приращение записывается
+ * асинхронно после вызова `StartWriteBuffer()`: сбрасывается n следующих битов области
+ * приращений, обычно одним циклом "только запись" на 8 приращений. Приращения, ожидающие
+ * записи, складываются. Значение счетчика только растет, `EEPROM_WriteWearLeveled()`
+ * для счетчика не действует. Значение 0xFFFFFFFF базы считается стертым (0).
+ *
+ * @param index Индекс параметра-счетчика (COUNTER в таблице не 0).
+ * @param n     Приращение.
+ * @return 1 - приращение поставлено в очередь, 0 - буфер переполнен или параметр не счетчик.
+ */
+uint8_t EEPROM_AddCounter(const uint8_t index, const uint16_t n);
+
+// Увеличивает счетчик на 1
+#define EEPROM_IncrementCounter(index) EEPROM_AddCounter((index), 1)
+
+/**
+ * @brief Возвращает значение счетчика (из ОЗУ, без обращения к EEPROM).
+ *
+ * Значение счетчика возвращают и функции чтения параметров (`EEPROM_ReadWearLeveled()`).
+ *
+ * @param index Индекс параметра-счетчика.
+ * @return Значение вместе с приращениями, ожидающими записи, 0 - параметр не счетчик.
+ */
+uint32_t EEPROM_ReadCounter(const uint8_t index);
+#endif
+
 /**
  * @brief Запускает процесс асинхронной записи в EEPROM.  
  *
  * Данные, добавленные в буфер с помощью `EEPROM_WriteWearLeveled()`, начнут 
- * записываться в EEPROM в фоне.  
+ * записываться в EEPROM в фоне. Если запись уже идет, новые данные будут
+ * записаны сразу после нее.
  * Вызов этой функции обязателен после внесения данных в буфер.  
  */
 void StartWriteBuffer(void);
 
+#if EEPROM_USE_TXN
+/**
+ * @brief Начинает транзакцию.
+ *
+ * Параметры, переданные в `EEPROM_WriteWearLeveled()` до `EEPROM_Commit()`, записываются
+ * в EEPROM одной группой: после сброса видны либо все новые значения, либо все старые.
+ * До `EEPROM_Commit()` буфер записи не передается на запись. Если в буфере уже есть
+ * группа, ожидающая записи, новая транзакция присоединяется к ней.
+ *
+ * @return 1 - транзакция начата, 0 - транзакция уже открыта.
+ */
+uint8_t EEPROM_BeginTransaction(void);
+
+/**
+ * @brief Завершает транзакцию и запускает запись группы.
+ *
+ * Если какая-либо запись группы не поместилась в буфер или в группе больше
+ * `EEPROM_TXN_MAX_PARAMS` разных параметров, группа целиком отбрасывается.
+ *
+ * @return 1 - группа поставлена в очередь записи, 0 - группа отброшена.
+ */
+uint8_t EEPROM_Commit(void);
+#endif
+
+/**
+ * @brief Запускает предварительное стирание следующих элементов всех параметров.
+ *
+ * Стирание выполняется в фоне, в промежутках между записями из буфера.
+ * После каждой записи элемента стирание продолжается автоматически, поэтому
+ * функцию достаточно вызвать один раз при старте после `EEPROM_Mount()`.
+ * Байт статуса не стирается и по-прежнему записывается атомарным циклом.
+ * Без `EEPROM_PRE_ERASE` функция ничего не делает.
+ */
+void EEPROM_PreErase(void);
+
+/**
+ * @brief Тик политики записи кэша, вызывается из основного цикла с постоянным периодом.
+ *
+ * Передает в буфер записи параметры, которые не менялись в течение своего
+ * затишья (QUIET в таблице параметров) или ждут записи дольше
+ * `EEPROM_SHADOW_MAX_AGE` тиков, и запускает запись. Без `EEPROM_USE_SHADOW`
+ * функция ничего не делает.
+ */
+void EEPROM_Tick(void);
+
+/**
+ * @brief Немедленно записывает все измененные параметры.
+ *
+ * Передает в буфер записи все незаписанные значения из кэша и запускает
+ * запись (например, перед выключением). Без `EEPROM_USE_SHADOW` равносильна
+ * `StartWriteBuffer()`. С `EEPROM_USE_GOVERNOR` параметры без бюджета записи
+ * остаются в кэше: перед выключением нужна `EEPROM_ForceFlush()`.
+ */
+void EEPROM_Flush(void);
+
+#if EEPROM_USE_EMERGENCY
+// Результат аварийной записи
+typedef struct {
+	uint8_t written;        // Записано записей буфера (кроме дописанной записи, начатой до вызова)
+	uint8_t dropped;        // Отброшено: не поместились во время удержания или в буфер записи
+	uint16_t elapsed_us;    // Затраченное время
+	uint16_t program_us;    // Время программирования, по которому велся расчет
+	uint8_t dropped_index[2 * MAX_WRITE_BUFFER_SIZE];  // Индексы параметров отброшенных записей
+} eeprom_emergency_report_t;
+
+/**
+ * @brief Аварийно записывает буфер записи при пропадании питания.
+ *
+ * Вызывается из обработчика пропадания питания (компаратор, BOD). Прерывание готовности
+ * EEPROM отключается, запись ведется опросом: сначала дописывается начатый элемент, затем
+ * ожидающие записи (с `EEPROM_USE_SHADOW` - и незаписанные значения кэша) в порядке
+ * убывания приоритета параметров. Запись начинается, только если она успевает до конца
+ * budget_us по наихудшей оценке (каждый байт - стирание + запись); записи, которые не
+ * успевают, пропускаются, и следующие, более короткие, еще могут быть записаны.
+ * Пропущенные записи удаляются из буфера (с кэшем значение снова помечается измененным,
+ * счетчик уменьшается на незаписанные приращения).
+ *
+ * @param budget_us Время удержания питания, мкс.
+ * @param report    Результат (может быть NULL).
+ * @return Количество отброшенных записей.
+ */
+uint8_t EEPROM_EmergencyFlush(const uint16_t budget_us, eeprom_emergency_report_t *report);
+#endif
+
+#if EEPROM_USE_SHADOW
+// Статистика кэша для настройки политики записи
+typedef struct {
+	uint32_t writes;          // Вызовов EEPROM_WriteWearLeveled()
+	uint32_t merged;          // Изменений, заменивших еще не записанное значение (сэкономленные элементы)
+	uint32_t flush_quiet;     // Записано по окончании затишья
+	uint32_t flush_age;       // Записано по максимальному возрасту изменения
+	uint32_t flush_explicit;  // Записано по EEPROM_Flush()
+	uint32_t deferred;        // Отложено до следующего тика из-за переполнения буфера записи
+#if EEPROM_USE_GOVERNOR
+	uint32_t overdraft;       // Записано по EEPROM_ForceFlush() без бюджета ограничителя износа
+#endif
+} eeprom_shadow_stats_t;
+
+/**
+ * @brief Возвращает статистику кэша.
+ *
+ * @param stats Структура, в которую копируются счетчики.
+ */
+void EEPROM_GetShadowStats(eeprom_shadow_stats_t *stats);
+#endif
+
+#if EEPROM_USE_GOVERNOR
+// Бюджет записи параметра
+typedef struct {
+	uint32_t interval;   // Тиков EEPROM_Tick() на одну запись: допустимая частота записи параметра
+	uint32_t wait;       // Тиков до следующей разрешенной записи (0 - запись разрешена сейчас)
+	uint8_t available;   // Записей, разрешенных подряд прямо сейчас (не более EEPROM_GOVERNOR_BURST)
+	uint8_t held;        // Измененное значение ждет бюджета в кэше
+} eeprom_write_budget_t;
+
+/**
+ * @brief Возвращает оставшийся бюджет записи параметра.
+ *
+ * Бюджет пополняется на одну запись за `interval` тиков `EEPROM_Tick()`. Пока его нет,
+ * `EEPROM_Tick()` и `EEPROM_Flush()` оставляют измененное значение в кэше и передают его
+ * в буфер записи, как только бюджет появится.
+ *
+ * @param index  Индекс параметра.
+ * @param budget Структура, в которую записывается бюджет.
+ */
+void EEPROM_GetWriteBudget(const uint8_t index, eeprom_write_budget_t *budget);
+
+/**
+ * @brief Записывает все измененные параметры, в том числе ожидающие бюджета записи.
+ *
+ * То же, что `EEPROM_Flush()`, но значения, которые ограничитель износа оставил в кэше,
+ * тоже передаются в буфер записи (перед выключением, перед сбросом). Такая запись
+ * берет бюджет в долг: следующая запись параметра будет разрешена позже. Количество
+ * записей сверх бюджета - `overdraft` в `EEPROM_GetShadowStats()`.
+ */
+void EEPROM_ForceFlush(void);
+#endif
+
+#if EEPROM_USE_STATS
+// Счетчики параметра (16-битные счетчики переполняются по кругу)
+typedef struct {
+	uint16_t requested;   // Вызовов записи
+	uint16_t skipped;     // Не записано: значение совпадает с записанным или ожидающим записи
+	uint16_t dropped;     // Отброшено: буфер записи переполнен или параметр не помещается в запись журнала
+	uint32_t programmed;  // Запрограммировано байт в области параметра (включая стирание и перенос)
+} eeprom_param_stats_t;
+
+// Общие счетчики
+typedef struct {
+	uint8_t queue_peak;       // Наибольшее количество записей в банке буфера записи
+	uint32_t isr_calls;       // Вызовов прерывания готовности EEPROM
+	uint32_t isr_cycles;      // Тактов в прерывании, всего
+	uint16_t isr_cycles_max;  // Тактов в самом долгом вызове прерывания
+	uint32_t lookups;         // Поисков текущего элемента (записи журнала)
+	uint32_t lookup_cycles;   // Тактов в поиске, всего (вместе с ожиданием окончания записи байта)
+} eeprom_stats_t;
+
+/**
+ * @brief Возвращает счетчики параметра.
+ *
+ * @param index Индекс параметра в EEPROM.
+ * @param stats Структура, в которую копируются счетчики.
+ */
+void EEPROM_GetParamStats(const uint8_t index, eeprom_param_stats_t *stats);
+
+/**
+ * @brief Возвращает общие счетчики.
+ *
+ * @param stats Структура, в которую копируются счетчики.
+ */
+void EEPROM_GetStats(eeprom_stats_t *stats);
+
+// Обнуляет все счетчики
+void EEPROM_ResetStats(void);
+
+/**
+ * @brief Оценивает количество циклов записи элемента кольцевого буфера по статусам.
+ *
+ * Статус растет на 1 с каждой записью параметра, поэтому количество записей с момента
+ * чистой EEPROM известно по модулю 2^8 (2^16) и количества элементов. Возвращается
+ * наименьшее согласованное с текущим элементом значение: оно точное, пока параметр записан
+ * меньше НОК(buffer_count, 2^(8*seq_size)) раз. Элементы, записанные с запуска, библиотека
+ * считает сама (`EEPROM_ResetStats()` их не обнуляет), и оценка не бывает меньше их количества:
+ * если с запуска записано больше, к ней добавляются целые периоды НОК и `*lower_bound`
+ * становится 1. Периоды, пройденные до запуска, по статусам не видны - для точного ресурса
+ * параметру с частой записью нужен 16-битный статус. Сильнее всего изношен текущий элемент.
+ * С журналом (EEPROM_USE_LOG) оценивается элемент журнала по номеру записи, общему для всех
+ * параметров, и index не используется.
+ *
+ * @param index       Индекс параметра в EEPROM.
+ * @param slot        Номер элемента кольцевого буфера.
+ * @param lower_bound Если не NULL: 1 - параметр записан не меньше НОК раз, результат - только
+ *                    нижняя граница, 0 - выхода за НОК за время работы не было.
+ * @return Оценка количества записей элемента.
+ */
+uint32_t EEPROM_EstimateWear(const uint8_t index, const uint16_t slot, uint8_t *lower_bound);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* EEPROM_H_ */
@@ -0,0 +1,271 @@
+/*
+ * eeprom.hpp
+ *
+ *  Author: https://github.com/AntonNeutron/EEPROM_WearLeveling
+ */
+
+/*
+  Фронтенд на C++ (C++11, без стандартной библиотеки): таблица параметров описывается типами
+  вместо скрипта на питоне из eeprom.c.
+
+    struct LcdLight : eeprom::Param<uint8_t, 5> {};
+    struct BatMinV  : eeprom::Param<uint16_t, 100> {};
+    typedef eeprom::Layout<4000, 100, LcdLight, BatMinV> Settings;  // EEPROM_SIZE, EEPROM_START_ADR, параметры
+
+    EEPROM_DEFINE_LAYOUT(Settings);  // в одном .cpp файле: таблица param_eeprom для eeprom.c
+
+    uint16_t v = Settings::read<BatMinV>();
+    Settings::write<BatMinV>(v);     // Settings::write<BatMinV>(uint8_t(1)) - ошибка компиляции
+
+  Счетчик (EEPROM_USE_COUNTER): struct Hours : eeprom::Counter<4, 16> {}; Settings::add<Hours>();
+
+  Адреса параметров (во внешней EEPROM - с выравниванием по страницам, см. EEPROM_RING_BYTES)
+  и проверка переполнения EEPROM вычисляются при компиляции, чтение и запись проверяют тип
+  значения. Сами чтение и запись выполняют те же функции eeprom.c (EEPROM_ReadParamValue(),
+  EEPROM_WriteParamValue()): шаблоны лишь передают им описание параметра из констант вместо
+  копирования строки таблицы из flash. Поиск текущего элемента и постановка в буфер записи
+  для каждого параметра не специализируются. Индекс параметра - его
+  позиция в Layout, функции C API (EEPROM_WriteWearLeveled() и др.) работают как прежде:
+  EEPROM_ReadWearLeveledByte(Settings::index_of<LcdLight>()).
+
+  eeprom.c собирается с -DEEPROM_PARAM_COUNT=<количество параметров> (с кэшем EEPROM_USE_SHADOW
+  и копией значений EEPROM_USE_READ_CACHE также -DEEPROM_DATA_SIZE=<суммарный размер параметров>),
+  EEPROM_DEFINE_LAYOUT() проверяет их. Без EEPROM_DATA_SIZE копия значений по умолчанию отключена.
+*/
+
+#ifndef EEPROM_HPP_
+#define EEPROM_HPP_
+
+#include "eeprom_hal.h"
+#include "eeprom.h"
+
+namespace eeprom {
+
+/**
+ * @brief Описание параметра.
+ *
+ * @tparam T     Тип значения (копируется побайтно).
+ * @tparam Count Количество элементов кольцевого буфера (с журналом EEPROM_USE_LOG не используется).
+ * @tparam Quiet Затишье в тиках EEPROM_Tick() для кэша EEPROM_USE_SHADOW.
+ * @tparam Seq   Размер счетчика: 1 или 2 байта, по умолчанию 2 для буферов длиннее 255 элементов.
+ * @tparam Priority Приоритет при аварийной записи (EEPROM_USE_EMERGENCY), больше - важнее.
+ */
+template <typename T, uint16_t Count, uint8_t Quiet = 10, uint8_t Seq = (Count < 256 ? 1 : 2), uint8_t Priority = 0>
+struct Param {
+	typedef T type;
+	static constexpr uint8_t size = sizeof(T);
+	static constexpr uint8_t seq = Seq;
+	static constexpr uint16_t count = Count;
+	static constexpr uint8_t quiet = Quiet;
+	static constexpr uint8_t counter = 0;
+	static constexpr uint8_t priority = Priority;
+	// Элемент со счетчиком и CRC
+	static constexpr uint16_t stride = sizeof(T) + Seq + EEPROM_CRC_SIZE;
+
+	static_assert(sizeof(T) <= 255, "размер параметра не более 255 байт");
+	static_assert(!EEPROM_HAL_PAGE_SIZE || stride <= EEPROM_HAL_PAGE_SIZE, "элемент не помещается в страницу EEPROM");
+
+	// Место в EEPROM (во внешней EEPROM элементы не пересекают границу страницы)
+	static constexpr uint32_t bytes = EEPROM_RING_BYTES((uint32_t)stride, (uint32_t)Count);
+
+	static_assert(Seq == 1 || Seq == 2, "счетчик может быть только 1 или 2 байта");
+	static_assert(Count > 0 && Count < (Seq == 1 ? 256UL : 65536UL), "слишком много элементов для счетчика");
+};
+
+/**
+ * @brief Описание счетчика (EEPROM_USE_COUNTER): база uint32_t в кольцевом буфере и две области
+ *        приращений по Bytes байт (8 приращений на байт).
+ */
+template <uint16_t Count, uint8_t Bytes, uint8_t Quiet = 10, uint8_t Seq = (Count < 256 ? 1 : 2), uint8_t Priority = 0>
+struct Counter : Param<uint32_t, Count, Quiet, Seq, Priority> {
+	static constexpr uint8_t counter = Bytes;
+	static constexpr uint32_t bytes = Param<uint32_t, Count, Quiet, Seq, Priority>::bytes + 2U * Bytes;
+
+	static_assert(EEPROM_USE_COUNTER || !Bytes, "счетчики: соберите с EEPROM_USE_COUNTER");
+	static_assert(Bytes > 0 && Bytes <= 248, "область приращений от 1 до 248 байт");
+};
+
+namespace detail {
+
+template <typename A, typename B> struct same { static constexpr bool value = false; };
+template <typename A> struct same<A, A> { static constexpr bool value = true; };
+
+template <uint8_t... I> struct seq {};
+template <uint8_t N, uint8_t... I> struct make_seq : make_seq<N - 1, N - 1, I...> {};
+template <uint8_t... I> struct make_seq<0, I...> { typedef seq<I...> type; };
+
+// Параметр с номером N
+template <uint8_t N, typename First, typename... Rest> struct nth : nth<N - 1, Rest...> {};
+template <typename First, typename... Rest> struct nth<0, First, Rest...> { typedef First type; };
+
+// Адрес параметра с номером N, если параметры размещаются с адреса At (каждый с начала страницы)
+template <uint32_t At, uint8_t N, typename First, typename... Rest> struct place {
+	static constexpr uint32_t value = place<EEPROM_PAGE_ALIGN(At) + First::bytes, N - 1, Rest...>::value;
+};
+template <uint32_t At, typename First, typename... Rest> struct place<At, 0, First, Rest...> {
+	static constexpr uint32_t value = EEPROM_PAGE_ALIGN(At);
+};
+
+// Номер параметра P (параметра нет в списке - ошибка компиляции "incomplete type")
+template <typename P, typename... List> struct position;
+template <typename P, typename... Rest> struct position<P, P, Rest...> {
+	static constexpr uint8_t value = 0;
+};
+template <typename P, typename First, typename... Rest> struct position<P, First, Rest...> {
+	static constexpr uint8_t value = 1 + position<P, Rest...>::value;
+};
+
+// Суммы по всем параметрам
+template <typename... List> struct total {
+	static constexpr uint32_t size = 0;      // Размер данных (кэш в ОЗУ)
+	static constexpr uint8_t max_size = 0;   // Наибольший размер параметра
+};
+template <typename First, typename... Rest> struct total<First, Rest...> {
+	static constexpr uint32_t size = First::size + total<Rest...>::size;
+	static constexpr uint8_t max_size = First::size > total<Rest...>::max_size ? First::size : total<Rest...>::max_size;
+};
+
+} // namespace detail
+
+/**
+ * @brief Размещение параметров в EEPROM.
+ *
+ * Параметры размещаются подряд начиная со Start, как в скрипте на питоне.
+ *
+ * @tparam Size   Размер EEPROM (EEPROM_SIZE).
+ * @tparam Start  Начальный адрес (EEPROM_START_ADR).
+ * @tparam Params Описания параметров (eeprom::Param), индекс параметра - номер в списке.
+ */
+template <uint16_t Size, uint16_t Start, typename... Params>
+struct Layout {
+	static constexpr uint8_t count = sizeof...(Params);
+	static constexpr uint32_t end = detail::place<Start, count - 1, Params...>::value
+	                              + detail::nth<count - 1, Params...>::type::bytes;
+	static constexpr uint16_t data_size = detail::total<Params...>::size;
+
+	static_assert(sizeof...(Params) > 0 && sizeof...(Params) < 256, "от 1 до 255 параметров");
+#if EEPROM_USE_LOG
+	// Все параметры пишутся в общий журнал, _COUNT не используется
+	static_assert(sizeof...(Params) <= EEPROM_LOG_MAX_PARAMS, "увеличьте EEPROM_LOG_MAX_PARAMS");
+	static_assert(detail::total<Params...>::max_size <= EEPROM_LOG_VALUE_SIZE, "параметр не помещается в запись журнала (EEPROM_LOG_VALUE_SIZE)");
+	static_assert(Start < Size && EEPROM_RING_SLOTS(Size - EEPROM_PAGE_ALIGN(Start), EEPROM_LOG_RECORD_SIZE) >= sizeof...(Params) + 2,
+	              "журнал слишком мал для всех параметров");
+#else
+	static_assert(end <= Size, "блоки переменных не помещаются в EEPROM");
+#endif
+	static_assert(Start >= EEPROM_TXN_AREA_SIZE, "журнал транзакций (EEPROM_TXN_AREA_SIZE байт) не помещается перед Start");
+	static_assert(!EEPROM_USE_TXN || EEPROM_PAGE_ALIGN(Start) == Start, "с журналом транзакций Start - начало страницы EEPROM");
+
+	// Индекс параметра P
+	template <typename P>
+	static constexpr uint8_t index_of() {
+		return detail::position<P, Params...>::value;
+	}
+
+	// Начальный адрес параметра с индексом I
+	template <uint8_t I>
+	static constexpr uint16_t addr() {
+		return (uint16_t)detail::place<Start, I, Params...>::value;
+	}
+
+	// Описание параметра с индексом I (строка таблицы param_eeprom)
+	template <uint8_t I>
+	static constexpr param_eeprom_t entry() {
+		typedef typename detail::nth<I, Params...>::type P;
+		return param_eeprom_t{P::size, P::seq, P::count, addr<I>(), P::quiet, P::counter, P::priority};
+	}
+
+	/**
+	 * @brief Читает значение параметра P (см. `EEPROM_ReadWearLeveledBlock()`).
+	 */
+	template <typename P>
+	static typename P::type read() {
+		const param_eeprom_t param = entry<index_of<P>()>();
+		typename P::type value;
+		EEPROM_ReadParamValue(index_of<P>(), &param, &value, sizeof(value));
+		return value;
+	}
+
+	/**
+	 * @brief Читает значение параметра P без ожидания записи EEPROM (см. `EEPROM_TryReadWearLeveledBlock()`).
+	 *
+	 * @return true - значение прочитано в value, false - EEPROM занята, value не изменено.
+	 */
+	template <typename P>
+	static bool try_read(typename P::type &value) {
+		const param_eeprom_t param = entry<index_of<P>()>();
+		return EEPROM_TryReadParamValue(index_of<P>(), &param, &value, sizeof(value)) != 0;
+	}
+
+	/**
+	 * @brief Добавляет значение параметра P в буфер записи (см. `EEPROM_WriteWearLeveled()`).
+	 *
+	 * Тип значения должен совпадать с типом параметра без преобразований.
+	 */
+	template <typename P, typename V>
+	static void write(const V &value) {
+		static_assert(detail::same<V, typename P::type>::value, "тип значения не совпадает с типом параметра");
+		const param_eeprom_t param = entry<index_of<P>()>();
+		EEPROM_WriteParamValue(index_of<P>(), &param, &value);
+	}
+
+#if EEPROM_USE_COUNTER
+	/**
+	 * @brief Увеличивает счетчик P на n (см. `EEPROM_AddCounter()`).
+	 */
+	template <typename P>
+	static bool add(uint16_t n = 1) {
+		static_assert(P::counter > 0, "параметр не является счетчиком (eeprom::Counter)");
+		return EEPROM_AddCounter(index_of<P>(), n) != 0;
+	}
+#endif
+
+#if EEPROM_USE_GOVERNOR
+	/**
+	 * @brief Оставшийся бюджет записи параметра P (см. `EEPROM_GetWriteBudget()`).
+	 */
+	template <typename P>
+	static eeprom_write_budget_t budget() {
+		eeprom_write_budget_t value;
+		EEPROM_GetWriteBudget(index_of<P>(), &value);
+		return value;
+	}
+#endif
+
+#ifdef EEPROM_PARAM_COUNT
+	// Таблица параметров для eeprom.c
+	static constexpr eeprom_layout_t table() {
+		return table(typename detail::make_seq<sizeof...(Params)>::type());
+	}
+
+	template <uint8_t... I>
+	static constexpr eeprom_layout_t table(detail::seq<I...>) {
+		return eeprom_layout_t{Size, Start, {entry<I>()...}};
+	}
+#endif
+};
+
+} // namespace eeprom
+
+#ifdef EEPROM_PARAM_COUNT
+#ifdef EEPROM_DATA_SIZE
+#define EEPROM_LAYOUT_DATA_CHECK(L) \
+	static_assert(L::data_size == EEPROM_DATA_SIZE, "EEPROM_DATA_SIZE не совпадает с суммарным размером параметров")
+#else
+#define EEPROM_LAYOUT_DATA_CHECK(L) \
+	static_assert(!EEPROM_USE_SHADOW && !EEPROM_USE_READ_CACHE, "EEPROM_USE_SHADOW, EEPROM_USE_READ_CACHE: задайте EEPROM_DATA_SIZE")
+#endif
+
+/**
+ * @brief Определяет таблицу параметров eeprom.c по описанию L (в одном .cpp файле приложения).
+ */
+#define EEPROM_DEFINE_LAYOUT(L)                                                                    \
+	static_assert(L::count == EEPROM_PARAM_COUNT, "EEPROM_PARAM_COUNT не совпадает с количеством параметров"); \
+	EEPROM_LAYOUT_DATA_CHECK(L);                                                                   \
+	extern "C" const eeprom_layout_t eeprom_layout PROGMEM = L::table()
+#else
+#define EEPROM_DEFINE_LAYOUT(L) \
+	static_assert(sizeof(L) == 0, "таблица из eeprom.hpp: соберите проект с -DEEPROM_PARAM_COUNT=<количество параметров>")
+#endif
+
+#endif /* EEPROM_HPP_ */
@@ -0,0 +1,191 @@
+/*
+ * eeprom_hal.h
+ *
+ *  Author: https://github.com/AntonNeutron/EEPROM_WearLeveling
+ */
+
+/*
+  Слой абстракции от аппаратуры для eeprom.c.
+
+  На AVR макросы отображаются на avr-libc и регистры EECR/EEAR/EEDR,
+  прерывание готовности EEPROM - ISR(EE_READY_vect).
+  На хосте (Linux) те же макросы вызывают симулятор EEPROM из каталога host/,
+  который моделирует время программирования байта и вызывает обработчик
+  прерывания готовности по своему таймеру.
+
+  Внешняя EEPROM со страничной записью (24Cxx по I2C, 25xx по SPI) подключается
+  через -DEEPROM_HAL_PAGE_SIZE=<размер страницы>. Тогда макросы вызывают функции
+  eeprom_hal_* драйвера шины (на хосте - симулятор страничной EEPROM), запись
+  идет страницами: один элемент кольцевого буфера - одна команда записи.
+*/
+
+#ifndef EEPROM_HAL_H_
+#define EEPROM_HAL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Режимы программирования байта (значение битов EEPM1:0)
+enum {
+	EEPROM_HAL_ERASE_WRITE = 0,  // Стирание + запись (атомарно, ~3.4 мс)
+	EEPROM_HAL_ERASE_ONLY = 1,   // Только стирание: ячейка становится 0xFF (~1.8 мс)
+	EEPROM_HAL_WRITE_ONLY = 2,   // Только запись: биты можно только сбросить 1 -> 0 (~1.8 мс)
+};
+
+// Размер страницы внешней EEPROM, 0 - встроенная EEPROM с побайтной записью
+#ifndef EEPROM_HAL_PAGE_SIZE
+#define EEPROM_HAL_PAGE_SIZE 0
+#endif
+
+#if defined(__AVR__)
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#if !EEPROM_HAL_PAGE_SIZE
+#include <avr/eeprom.h>
+
+// Чтение EEPROM (avr-libc сама дожидается окончания текущей записи)
+#define EEPROM_HAL_READ_BYTE(address)             eeprom_read_byte((const uint8_t *)(uint16_t)(address))
+#define EEPROM_HAL_READ_BLOCK(dst, address, size) eeprom_read_block((dst), (const void *)(uint16_t)(address), (size))
+
+// Запуск программирования байта. Вызывается только из прерывания готовности EEPROM
+#if defined(EEPM0)
+// Раздельные стирание и запись (ATmega48/88/168/328, ATtiny и др.)
+#define EEPROM_HAL_HAS_SPLIT_PROGRAMMING 1
+#define EEPROM_HAL_PROGRAM_BYTE(address, data, mode) do {                      \
+		EEAR = (address);                                                     \
+		EEDR = (data);                                                        \
+		EECR = (EECR & ~((1 << EEPM1) | (1 << EEPM0))) | ((mode) << EEPM0);   \
+		EECR |= (1 << EEMPE);                                                 \
+		EECR |= (1 << EEPE);                                                  \
+	} while (0)
+// Идет программирование: чтение EEPROM дождалось бы его окончания
+#define EEPROM_HAL_BUSY() (EECR & (1 << EEPE))
+// Ожидание окончания программирования (с разрешенными прерываниями)
+#define EEPROM_HAL_WAIT_READY() eeprom_busy_wait()
+#else
+// Только атомарный режим (ATmega128 и др.), режим игнорируется
+#define EEPROM_HAL_HAS_SPLIT_PROGRAMMING 0
+#define EEPROM_HAL_PROGRAM_BYTE(address, data, mode) do { \
+		(void)(mode);                                         \
+		EEAR = (address);                                     \
+		EEDR = (data);                                        \
+		EECR |= (1 << EEMWE);                                 \
+		EECR |= (1 << EEWE);                                  \
+	} while (0)
+#define EEPROM_HAL_BUSY() (EECR & (1 << EEWE))
+#define EEPROM_HAL_WAIT_READY() eeprom_busy_wait()
+#endif
+
+// Блокирующая запись байта (ждет окончания предыдущего программирования, совпадающий байт не пишет).
+// Только пока не идет фоновая запись (восстановление при монтировании)
+#define EEPROM_HAL_WRITE_BYTE(address, data) eeprom_update_byte((uint8_t *)(uint16_t)(address), (data))
+
+// Разрешение / запрет прерывания готовности EEPROM, разрешено ли оно сейчас
+#define EEPROM_HAL_READY_IRQ_ENABLE()  (EECR |= (1 << EERIE))
+#define EEPROM_HAL_READY_IRQ_DISABLE() (EECR &= ~(1 << EERIE))
+#define EEPROM_HAL_READY_IRQ_ENABLED() (EECR & (1 << EERIE))
+
+// Обработчик прерывания готовности EEPROM
+#define EEPROM_HAL_READY_ISR() ISR(EE_READY_vect)
+#endif /* !EEPROM_HAL_PAGE_SIZE */
+
+// Критическая секция относительно прерывания готовности EEPROM: EEPROM_HAL_ATOMIC_BLOCK() { ... }
+#define EEPROM_HAL_ATOMIC_BLOCK() ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+
+// Счетчик тактов для статистики (EEPROM_USE_STATS), 16 бит. По умолчанию - таймер 1,
+// приложение запускает его без предделителя. Можно переопределить на другой таймер
+#ifndef EEPROM_HAL_CYCLES
+#define EEPROM_HAL_CYCLES() ((uint16_t)TCNT1)
+#endif
+// Тактов EEPROM_HAL_CYCLES() в микросекунде (аварийная запись EEPROM_USE_EMERGENCY)
+#ifndef EEPROM_HAL_CYCLES_PER_US
+#define EEPROM_HAL_CYCLES_PER_US (F_CPU / 1000000UL)
+#endif
+
+#else /* хост */
+
+// Таблица параметров на хосте лежит в обычной памяти
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+
+#define EEPROM_HAL_CYCLES()                       eeprom_hal_cycles()
+// Как EEPROM_SIM_CPU_MHZ симулятора
+#ifndef EEPROM_HAL_CYCLES_PER_US
+#define EEPROM_HAL_CYCLES_PER_US 16
+#endif
+
+// Симулятор вызывает обработчик прерывания из eeprom_sim_run(), т.е. между вызовами API библиотеки,
+// а в режиме вытеснения (eeprom_sim_preempt()) - и внутри них, в точках обращения к HAL и на выходе
+// из критической секции. Поэтому критическая секция отмечается для симулятора; как ATOMIC_BLOCK
+// в avr-libc, выход отмечается и при return/break из блока
+#define EEPROM_HAL_ATOMIC_BLOCK()                                                                       \
+	for (uint8_t eeprom_hal_once __attribute__((cleanup(eeprom_hal_atomic_leave))) = (eeprom_hal_atomic_enter(), 1); \
+	     eeprom_hal_once; eeprom_hal_once = 0)
+
+#endif
+
+#if !defined(__AVR__) || EEPROM_HAL_PAGE_SIZE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Реализация в host/eeprom_sim.c или, для внешней EEPROM на МК, в драйвере шины
+uint8_t eeprom_hal_read_byte(uint16_t address);
+void eeprom_hal_read_block(void *dst, uint16_t address, uint8_t size);
+// Блокирующая запись байта, совпадающий байт не пишется
+void eeprom_hal_write_byte(uint16_t address, uint8_t data);
+// Идет программирование (запись страницы): чтение дождалось бы его окончания
+uint8_t eeprom_hal_busy(void);
+// Ожидание окончания программирования
+void eeprom_hal_wait_ready(void);
+// Разрешение прерывания готовности. Драйвер внешней EEPROM вызывает eeprom_hal_ready_isr()
+// после окончания записи страницы (по таймеру или опросу ACK), пока оно разрешено
+void eeprom_hal_ready_irq(uint8_t enable);
+uint8_t eeprom_hal_ready_irq_enabled(void);
+#if EEPROM_HAL_PAGE_SIZE
+// Запуск записи size байт с адреса address в пределах одной страницы (без ожидания окончания)
+void eeprom_hal_program_page(uint16_t address, const uint8_t *data, uint8_t size);
+#else
+void eeprom_hal_program_byte(uint16_t address, uint8_t data, uint8_t mode);
+#endif
+#if !defined(__AVR__)
+uint16_t eeprom_hal_cycles(void);
+// Вход в критическую секцию и выход из нее, для EEPROM_HAL_ATOMIC_BLOCK()
+void eeprom_hal_atomic_enter(void);
+void eeprom_hal_atomic_leave(const uint8_t *once);
+#endif
+
+// Обработчик прерывания готовности, реализуется в eeprom.c и вызывается симулятором или драйвером
+void eeprom_hal_ready_isr(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define EEPROM_HAL_READ_BYTE(address)             eeprom_hal_read_byte((uint16_t)(address))
+#define EEPROM_HAL_READ_BLOCK(dst, address, size) eeprom_hal_read_block((dst), (uint16_t)(address), (size))
+#define EEPROM_HAL_WRITE_BYTE(address, data)      eeprom_hal_write_byte((uint16_t)(address), (data))
+#define EEPROM_HAL_BUSY()                         eeprom_hal_busy()
+#define EEPROM_HAL_WAIT_READY()                   eeprom_hal_wait_ready()
+#define EEPROM_HAL_READY_IRQ_ENABLE()             eeprom_hal_ready_irq(1)
+#define EEPROM_HAL_READY_IRQ_DISABLE()            eeprom_hal_ready_irq(0)
+#define EEPROM_HAL_READY_IRQ_ENABLED()            eeprom_hal_ready_irq_enabled()
+#define EEPROM_HAL_READY_ISR()                    void eeprom_hal_ready_isr(void)
+#if EEPROM_HAL_PAGE_SIZE
+// Страница пишется целиком за то же время, что и байт, раздельных стирания и записи нет
+#define EEPROM_HAL_PROGRAM_PAGE(address, data, size) eeprom_hal_program_page((uint16_t)(address), (data), (size))
+#define EEPROM_HAL_HAS_SPLIT_PROGRAMMING          0
+#else
+#define EEPROM_HAL_PROGRAM_BYTE(address, data, mode) eeprom_hal_program_byte((uint16_t)(address), (data), (mode))
+#define EEPROM_HAL_HAS_SPLIT_PROGRAMMING          1
+#endif
+
+#endif /* хост или внешняя EEPROM */
+
+#endif /* EEPROM_HAL_H_ */
@@ -0,0 +1,216 @@
+/*
+ * eeprom_log.c
+ *
+ *  Author: https://github.com/AntonNeutron/EEPROM_WearLeveling
+ */
+
+/*
+  Журнал параметров в общей области EEPROM (EEPROM_USE_LOG).
+
+  Вместо отдельного кольцевого буфера на каждый параметр все параметры дописывают
+  записи в один кольцевой журнал от EEPROM_START_ADR до EEPROM_SIZE. Все записи
+  одного размера EEPROM_LOG_RECORD_SIZE:
+
+    [номер записи, 2 байта][индекс параметра][данные, EEPROM_LOG_VALUE_SIZE байт][CRC-8]
+
+  Номер записи сквозной для всего журнала и записывается последним, поэтому прерванная
+  сбросом запись остается записью предыдущего круга. CRC считается по номеру, индексу и
+  element_size байтам данных параметра, остальные байты данных не программируются.
+
+  Последняя запись каждого параметра (живая) хранится в таблице в ОЗУ, которая заполняется
+  одним проходом по журналу при монтировании. Запись идет в элемент за головой журнала, и
+  перед каждой записью проверяется следующий за ним элемент: если в нем живая запись, она
+  сначала переносится в голову (уплотнение). Поэтому элемент за головой всегда свободен,
+  а перенос выполняется побайтно из прерывания готовности EEPROM наравне с обычными записями.
+*/
+
+#include "eeprom_hal.h"
+#include "eeprom_log.h"
+
+#if EEPROM_USE_LOG
+
+#define EEPROM_LOG_SEQ    0  // Смещение номера записи
+#define EEPROM_LOG_INDEX  2  // Смещение индекса параметра
+#define EEPROM_LOG_DATA   3  // Смещение данных
+#define EEPROM_LOG_CRC    (EEPROM_LOG_DATA + EEPROM_LOG_VALUE_SIZE)
+
+// Индекс 0xFF - стертая запись
+extern uint8_t error_eeprom_log_max_params[EEPROM_LOG_MAX_PARAMS > 255 ? -1 : 0];
+
+// Область журнала
+static uint16_t log_start;
+static uint16_t log_slots;
+
+// Голова журнала (последняя записанная запись) и ее номер
+static volatile uint16_t log_head;
+static volatile uint16_t log_head_seq;
+// Последняя запись каждого параметра
+static volatile uint16_t log_last[EEPROM_LOG_MAX_PARAMS];
+
+// Записываемый элемент (используется только в прерывании)
+static uint16_t log_slot;          // Элемент журнала
+static uint16_t log_seq;           // Номер записи
+static uint16_t log_source;        // Адрес данных переносимой записи, 0 - данные из буфера записи
+static const volatile uint8_t *log_data;
+static uint8_t log_index;
+static uint8_t log_size;
+static uint8_t log_crc;
+
+static inline uint16_t EEPROM_LogAddress(const uint16_t slot) {
+	return EEPROM_RING_ADDRESS(log_start, EEPROM_LOG_RECORD_SIZE, slot);
+}
+
+static inline uint16_t EEPROM_LogNextSlot(const uint16_t slot) {
+	return (slot + 1 == log_slots) ? 0 : slot + 1;
+}
+
+// Проверка записи: индекс параметра и номер записи возвращаются в *index и *seq
+static uint8_t EEPROM_LogCheck(const uint16_t slot, uint8_t *index, uint16_t *seq) {
+	uint16_t address = EEPROM_LogAddress(slot);
+	uint8_t crc = 0xFF;
+
+	*seq = EEPROM_HAL_READ_BYTE(address + EEPROM_LOG_SEQ);
+	*seq |= (uint16_t)EEPROM_HAL_READ_BYTE(address + EEPROM_LOG_SEQ + 1) << 8;
+	*index = EEPROM_HAL_READ_BYTE(address + EEPROM_LOG_INDEX);
+
+	uint8_t size = EEPROM_LogElementSize(*index);
+	if (size == 0)
+		return 0;
+	crc = EEPROM_Crc8(crc, (uint8_t)*seq);
+	crc = EEPROM_Crc8(crc, (uint8_t)(*seq >> 8));
+	crc = EEPROM_Crc8(crc, *index);
+	for (uint8_t i = 0; i < size; i++)
+		crc = EEPROM_Crc8(crc, EEPROM_HAL_READ_BYTE(address + EEPROM_LOG_DATA + i));
+	return EEPROM_HAL_READ_BYTE(address + EEPROM_LOG_CRC) == crc;
+}
+
+// Записи журнала идут подряд с номерами base, base+1, ... (base - номер записи в элементе 0 на текущем
+// круге, определяется по первой целой записи), в элементах после головы - записи предыдущего круга
+// с номерами на log_slots меньше. Поэтому (seq - base + log_slots) растет с каждой новой записью
+// на двух последних кругах, и самая новая запись находится за один проход без двоичного поиска
+void EEPROM_LogMount(const uint16_t start, const uint16_t end) {
+	uint16_t rank[EEPROM_LOG_MAX_PARAMS];
+	uint16_t head_rank = 0, base = 0, seq;
+	uint8_t index, found = 0;
+
+	log_start = EEPROM_PAGE_ALIGN(start);
+	log_slots = EEPROM_RING_SLOTS(end - log_start, EEPROM_LOG_RECORD_SIZE);
+	for (uint8_t i = 0; i < EEPROM_LOG_MAX_PARAMS; i++) {
+		log_last[i] = EEPROM_LOG_NONE;
+		rank[i] = 0;
+	}
+
+	for (uint16_t slot = 0; slot < log_slots; slot++) {
+		if (!EEPROM_LogCheck(slot, &index, &seq))
+			continue;
+		if (!found) {
+			base = seq - slot;
+			found = 1;
+		}
+		uint16_t r = seq - base + log_slots;
+		if (r >= head_rank) {
+			head_rank = r;
+			log_head = slot;
+			log_head_seq = seq;
+		}
+		if (log_last[index] == EEPROM_LOG_NONE || r > rank[index]) {
+			log_last[index] = slot;
+			rank[index] = r;
+		}
+	}
+
+	if (!found) {
+		// Чистая EEPROM: первая запись пойдет в элемент 0 с номером 0
+		log_head = log_slots - 1;
+		log_head_seq = 0xFFFF;
+	}
+}
+
+uint16_t EEPROM_LogFind(const uint8_t index) {
+	uint16_t slot;
+
+	if (index >= EEPROM_LOG_MAX_PARAMS)
+		return EEPROM_LOG_NONE;
+	EEPROM_HAL_ATOMIC_BLOCK() {
+		slot = log_last[index];
+	}
+	return (slot == EEPROM_LOG_NONE) ? EEPROM_LOG_NONE : EEPROM_LogAddress(slot) + EEPROM_LOG_DATA;
+}
+
+uint8_t EEPROM_LogBegin(const uint8_t index, const volatile uint8_t *data) {
+	uint16_t slot = EEPROM_LogNextSlot(log_head);
+	uint16_t tail = EEPROM_LogNextSlot(slot);
+	uint8_t tail_index = EEPROM_HAL_READ_BYTE(EEPROM_LogAddress(tail) + EEPROM_LOG_INDEX);
+
+	if (tail_index != index && tail_index < EEPROM_LOG_MAX_PARAMS && log_last[tail_index] == tail) {
+		// Живая запись стала бы следующей за головой - сначала переносим ее.
+		// Запись того же параметра переносить не нужно: новая запись ее заменяет
+		log_index = tail_index;
+		log_source = EEPROM_LogAddress(tail) + EEPROM_LOG_DATA;
+	} else {
+		log_index = index;
+		log_source = 0;
+		log_data = data;
+	}
+	log_slot = slot;
+	log_seq = log_head_seq + 1;
+	log_size = EEPROM_LogElementSize(log_index);
+
+	log_crc = EEPROM_Crc8(0xFF, (uint8_t)log_seq);
+	log_crc = EEPROM_Crc8(log_crc, (uint8_t)(log_seq >> 8));
+	log_crc = EEPROM_Crc8(log_crc, log_index);
+	for (uint8_t i = 0; i < log_size; i++)
+		log_crc = EEPROM_Crc8(log_crc, log_source ? EEPROM_HAL_READ_BYTE(log_source + i) : log_data[i]);
+
+	// Индекс, данные, CRC, номер записи
+	return 1 + log_size + 1 + 2;
+}
+
+void EEPROM_LogByte(const uint8_t pos, uint16_t *address, uint8_t *data) {
+	uint16_t record = EEPROM_LogAddress(log_slot);
+
+	if (pos == 0) {
+		*address = record + EEPROM_LOG_INDEX;
+		*data = log_index;
+	} else if (pos <= log_size) {
+		*address = record + EEPROM_LOG_DATA + pos - 1;
+		*data = log_source ? EEPROM_HAL_READ_BYTE(log_source + pos - 1) : log_data[pos - 1];
+	} else if (pos == log_size + 1) {
+		*address = record + EEPROM_LOG_CRC;
+		*data = log_crc;
+	} else {
+		uint8_t i = pos - log_size - 2;
+		*address = record + EEPROM_LOG_SEQ + i;
+		*data = (uint8_t)(log_seq >> (8 * i));
+	}
+}
+
+uint16_t EEPROM_LogHead(uint16_t *seq, uint16_t *slots) {
+	uint16_t head;
+
+	EEPROM_HAL_ATOMIC_BLOCK() {
+		head = log_head;
+		*seq = log_head_seq;
+	}
+	*slots = log_slots;
+	return head;
+}
+
+uint8_t EEPROM_LogRecordIndex(void) {
+	return log_index;
+}
+
+uint8_t EEPROM_LogCommit(void) {
+	log_head = log_slot;
+	log_head_seq = log_seq;
+	log_last[log_index] = log_slot;
+	return log_source == 0;
+}
+
+uint16_t EEPROM_LogRamUsage(void) {
+	return sizeof(log_start) + sizeof(log_slots) + sizeof(log_head) + sizeof(log_head_seq) + sizeof(log_last)
+	     + sizeof(log_slot) + sizeof(log_seq) + sizeof(log_source) + sizeof(log_data) + sizeof(log_index)
+	     + sizeof(log_size) + sizeof(log_crc);
+}
+
+#endif /* EEPROM_USE_LOG */
@@ -0,0 +1,52 @@
+/*
+ * eeprom_log.h
+ *
+ *  Author: https://github.com/AntonNeutron/EEPROM_WearLeveling
+ */
+
+/*
+  Внутренний интерфейс журнала (EEPROM_USE_LOG) между eeprom.c и eeprom_log.c.
+  Приложение использует только функции из eeprom.h.
+*/
+
+#ifndef EEPROM_LOG_H_
+#define EEPROM_LOG_H_
+
+#include <stdint.h>
+#include "eeprom.h"
+
+// Параметр не имеет записей в журнале
+#define EEPROM_LOG_NONE 0xFFFF
+
+// Монтирует журнал в области [start, end): один проход по всем записям, заполняет таблицу последних записей
+void EEPROM_LogMount(const uint16_t start, const uint16_t end);
+
+// Адрес данных последней записи параметра или EEPROM_LOG_NONE, если записей нет
+uint16_t EEPROM_LogFind(const uint8_t index);
+
+// Начинает запись элемента в голову журнала (вызывается из прерывания готовности).
+// Если живую запись в хвосте нужно сначала перенести, начинается перенос, а запись
+// параметра - после него (см. EEPROM_LogCommit()). Возвращает количество байт элемента
+uint8_t EEPROM_LogBegin(const uint8_t index, const volatile uint8_t *data);
+
+// Адрес и значение байта элемента с номером pos (в порядке записи, номер записи - последним)
+void EEPROM_LogByte(const uint8_t pos, uint16_t *address, uint8_t *data);
+
+// Голова журнала (последняя запись) и ее номер, количество элементов журнала возвращается в *slots
+uint16_t EEPROM_LogHead(uint16_t *seq, uint16_t *slots);
+
+// Индекс параметра записываемого элемента (при переносе - переносимого параметра)
+uint8_t EEPROM_LogRecordIndex(void);
+
+// Фиксирует записанный элемент. Возвращает 1 для записи параметра, 0 для переноса
+uint8_t EEPROM_LogCommit(void);
+
+// Объем ОЗУ журнала, байт
+uint16_t EEPROM_LogRamUsage(void);
+
+// Реализуются в eeprom.c
+// Размер данных параметра или 0, если параметра нет или он не помещается в запись журнала
+uint8_t EEPROM_LogElementSize(const uint8_t index);
+uint8_t EEPROM_Crc8(uint8_t crc, const uint8_t data);
+
+#endif /* EEPROM_LOG_H_ */
@@ -0,0 +1,89 @@
+/*
+ * bench_layout.h
+ *
+ *  Author: https://github.com/AntonNeutron/EEPROM_WearLeveling
+ */
+
+/*
+  Таблица параметров для eeprom_bench (подключается в eeprom.c через EEPROM_LAYOUT_FILE).
+  Размер кольцевых буферов задается при сборке: -DBENCH_COUNT=<количество элементов>.
+  С журналом (EEPROM_USE_LOG) BENCH_COUNT - количество записей в общем журнале.
+  Порядок параметров должен совпадать с enum в eeprom_bench.c.
+  С транзакциями (EEPROM_USE_TXN) параметры начинаются после журнала транзакций.
+  Со счетчиками (EEPROM_USE_COUNTER) добавляется параметр-счетчик BENCH_COUNTER.
+  Приоритет аварийной записи (EEPROM_USE_EMERGENCY) растет с размером параметра.
+*/
+
+#ifndef BENCH_COUNT
+#define BENCH_COUNT 100
+#endif
+
+// Для буферов длиннее 255 элементов нужен 2-байтовый счетчик
+#define BENCH_SEQ (BENCH_COUNT < 256 ? 1 : 2)
+
+enum {
+#if EEPROM_USE_LOG
+	EEPROM_SIZE = EEPROM_RING_BYTES(EEPROM_LOG_RECORD_SIZE, BENCH_COUNT),
+#else
+	EEPROM_SIZE = 65535,
+#endif
+	EEPROM_START_ADR = EEPROM_TXN_AREA_SIZE,  // Перед параметрами - журнал транзакций
+
+	BENCH_BYTE_SIZE = sizeof(uint8_t),
+	BENCH_BYTE_SEQ = BENCH_SEQ,
+	BENCH_BYTE_COUNT = BENCH_COUNT,
+	BENCH_BYTE_QUIET = 10,
+	BENCH_BYTE_COUNTER = 0,
+	BENCH_BYTE_PRIORITY = 0,
+	BENCH_BYTE_ADDR = EEPROM_PAGE_ALIGN(EEPROM_START_ADR),
+	BENCH_BYTE_END = BENCH_BYTE_ADDR + EEPROM_RING_BYTES(BENCH_BYTE_SIZE + BENCH_BYTE_SEQ + EEPROM_CRC_SIZE, BENCH_BYTE_COUNT) + 2 * BENCH_BYTE_COUNTER,
+
+	BENCH_WORD_SIZE = sizeof(uint16_t),
+	BENCH_WORD_SEQ = BENCH_SEQ,
+	BENCH_WORD_COUNT = BENCH_COUNT,
+	BENCH_WORD_QUIET = 10,
+	BENCH_WORD_COUNTER = 0,
+	BENCH_WORD_PRIORITY = 1,
+	BENCH_WORD_ADDR = EEPROM_PAGE_ALIGN(BENCH_BYTE_END),
+	BENCH_WORD_END = BENCH_WORD_ADDR + EEPROM_RING_BYTES(BENCH_WORD_SIZE + BENCH_WORD_SEQ + EEPROM_CRC_SIZE, BENCH_WORD_COUNT) + 2 * BENCH_WORD_COUNTER,
+
+	BENCH_BLOCK_SIZE = sizeof(uint32_t),
+	BENCH_BLOCK_SEQ = BENCH_SEQ,
+	BENCH_BLOCK_COUNT = BENCH_COUNT,
+	BENCH_BLOCK_QUIET = 10,
+	BENCH_BLOCK_COUNTER = 0,
+	BENCH_BLOCK_PRIORITY = 2,
+	BENCH_BLOCK_ADDR = EEPROM_PAGE_ALIGN(BENCH_WORD_END),
+	BENCH_BLOCK_END = BENCH_BLOCK_ADDR + EEPROM_RING_BYTES(BENCH_BLOCK_SIZE + BENCH_BLOCK_SEQ + EEPROM_CRC_SIZE, BENCH_BLOCK_COUNT) + 2 * BENCH_BLOCK_COUNTER,
+
+#if EEPROM_USE_COUNTER
+	// Счетчик: база в кольцевом буфере и две области приращений по 16 байт (128 приращений)
+	BENCH_COUNTER_SIZE = sizeof(uint32_t),
+	BENCH_COUNTER_SEQ = BENCH_SEQ,
+	BENCH_COUNTER_COUNT = BENCH_COUNT,
+	BENCH_COUNTER_QUIET = 10,
+	BENCH_COUNTER_COUNTER = 16,
+	BENCH_COUNTER_PRIORITY = 3,
+	BENCH_COUNTER_ADDR = EEPROM_PAGE_ALIGN(BENCH_BLOCK_END),
+	BENCH_COUNTER_END = BENCH_COUNTER_ADDR + EEPROM_RING_BYTES(BENCH_COUNTER_SIZE + BENCH_COUNTER_SEQ + EEPROM_CRC_SIZE, BENCH_COUNTER_COUNT) + 2 * BENCH_COUNTER_COUNTER,
+
+	BENCH_END = BENCH_COUNTER_END,
+	EEPROM_DATA_SIZE = BENCH_BYTE_SIZE + BENCH_WORD_SIZE + BENCH_BLOCK_SIZE + BENCH_COUNTER_SIZE,
+#else
+	BENCH_END = BENCH_BLOCK_END,
+	EEPROM_DATA_SIZE = BENCH_BYTE_SIZE + BENCH_WORD_SIZE + BENCH_BLOCK_SIZE,
+#endif
+};
+
+extern uint8_t error_eeprom_overflow[(!EEPROM_USE_LOG && BENCH_END > EEPROM_SIZE) ? -1 : 0];
+extern uint8_t error_eeprom_log_value[(EEPROM_USE_LOG && (BENCH_BYTE_SIZE > EEPROM_LOG_VALUE_SIZE || BENCH_WORD_SIZE > EEPROM_LOG_VALUE_SIZE
+                                       || BENCH_BLOCK_SIZE > EEPROM_LOG_VALUE_SIZE)) ? -1 : 0];
+
+const param_eeprom_t param_eeprom[] PROGMEM = {
+	{BENCH_BYTE_SIZE, BENCH_BYTE_SEQ, BENCH_BYTE_COUNT, BENCH_BYTE_ADDR, BENCH_BYTE_QUIET, BENCH_BYTE_COUNTER, BENCH_BYTE_PRIORITY},
+	{BENCH_WORD_SIZE, BENCH_WORD_SEQ, BENCH_WORD_COUNT, BENCH_WORD_ADDR, BENCH_WORD_QUIET, BENCH_WORD_COUNTER, BENCH_WORD_PRIORITY},
+	{BENCH_BLOCK_SIZE, BENCH_BLOCK_SEQ, BENCH_BLOCK_COUNT, BENCH_BLOCK_ADDR, BENCH_BLOCK_QUIET, BENCH_BLOCK_COUNTER, BENCH_BLOCK_PRIORITY},
+#if EEPROM_USE_COUNTER
+	{BENCH_COUNTER_SIZE, BENCH_COUNTER_SEQ, BENCH_COUNTER_COUNT, BENCH_COUNTER_ADDR, BENCH_COUNTER_QUIET, BENCH_COUNTER_COUNTER, BENCH_COUNTER_PRIORITY},
+#endif
+};
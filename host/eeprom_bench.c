@@ -0,0 +1,733 @@
+/*
+ * eeprom_bench.c
+ *
+ *  Author: https://github.com/AntonNeutron/EEPROM_WearLeveling
+ */
+
+/*
+  Замер стоимости вызовов API на симуляторе EEPROM: количество чтений и
+  запрограммированных байт, а также симулированное время на один вызов.
+  Размер кольцевых буферов и наличие таблицы в ОЗУ задаются при сборке (см. Makefile).
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "eeprom.h"
+#include "eeprom_sim.h"
+
+#ifndef BENCH_COUNT
+#define BENCH_COUNT 100
+#endif
+
+// Количество вызовов каждой функции при замере
+#ifndef BENCH_CALLS
+#define BENCH_CALLS 1000
+#endif
+
+// Количество элементов, при записи которых моделируется сброс
+#define BENCH_CRASH_RECORDS 8
+
+// Период вызова EEPROM_Tick(), мс, и затишье параметров из bench_layout.h в тиках
+#define BENCH_TICK_MS 100
+#define BENCH_QUIET_TICKS 10
+
+// Сколько интервалов ограничителя износа BENCH_BLOCK меняется на каждом тике
+#define BENCH_GOVERNOR_INTERVALS 8
+
+// Наибольший период статусов НОК(BENCH_COUNT, 2^(8*SEQ)), который проверяется целиком
+#define BENCH_WEAR_PERIOD_MAX 10000
+
+// Параметры в порядке таблицы bench_layout.h
+enum {
+	BENCH_BYTE,
+	BENCH_WORD,
+	BENCH_BLOCK,
+	BENCH_PARAMS,
+	BENCH_COUNTER = BENCH_PARAMS  // EEPROM_USE_COUNTER: пишется только приращениями
+};
+
+static eeprom_sim_stats_t bench_start;
+
+static void bench_begin(void) {
+	bench_start = *eeprom_sim_stats();
+}
+
+static void bench_report(const char *name, uint32_t calls) {
+	const eeprom_sim_stats_t *now = eeprom_sim_stats();
+
+	printf("  %-30s %6u %12.2f %12.2f %14.3f\n", name, calls,
+	       (double)(now->reads - bench_start.reads) / calls,
+	       (double)(now->programs - bench_start.programs) / calls,
+	       (double)(now->time_ns - bench_start.time_ns) / calls / 1000.0);
+}
+
+// Следующее значение параметра: псевдослучайное, чтобы менялись все байты данных
+static uint32_t bench_next(uint32_t value) {
+	return value * 1103515245UL + 12345UL;
+}
+
+// Запуск записи. С ограничителем износа (EEPROM_USE_GOVERNOR) замеры пишут чаще, чем позволяет бюджет:
+// сначала проходят тики, за которые бюджет параметров восстанавливается (время симулятора не идет)
+static void bench_flush(void) {
+#if EEPROM_USE_GOVERNOR
+	for (uint8_t index = 0; index < BENCH_PARAMS; index++) {
+		eeprom_write_budget_t budget;
+		EEPROM_GetWriteBudget(index, &budget);
+		while (budget.wait--)
+			EEPROM_Tick();
+	}
+#endif
+	EEPROM_Flush();
+}
+
+// Записывает новое значение параметра и дожидается окончания записи
+static void bench_write(uint8_t index, uint32_t value) {
+	EEPROM_WriteWearLeveled(index, &value);
+	bench_flush();
+	eeprom_sim_run_until_idle();
+}
+
+int main(void) {
+	uint32_t value = 0;
+
+	if (eeprom_sim_init(NULL, 65536) != 0) {
+		fprintf(stderr, "eeprom_sim_init failed\n");
+		return 1;
+	}
+
+	// Заполняем буферы на полтора круга, чтобы текущий элемент оказался в середине
+	// BENCH_BYTE после заполнения больше не меняется и должен сохраниться до конца (в журнале - переносами)
+	uint8_t cold_value = 0;
+	for (uint32_t i = 0; i < BENCH_COUNT + BENCH_COUNT / 2; i++)
+		for (uint8_t index = 0; index < BENCH_PARAMS; index++) {
+			bench_write(index, value = bench_next(value));
+			if (index == BENCH_BYTE)
+				cold_value = (uint8_t)value;
+		}
+
+	// Заранее стираем следующие элементы (если EEPROM_PRE_ERASE включен)
+	EEPROM_PreErase();
+	eeprom_sim_run_until_idle();
+
+#if EEPROM_USE_LOG
+	printf("shared log %u records of %u bytes, page %u, shadow %s, RAM %u bytes\n",
+	       BENCH_COUNT, EEPROM_LOG_RECORD_SIZE, EEPROM_HAL_PAGE_SIZE, EEPROM_USE_SHADOW ? "on" : "off",
+	       EEPROM_GetRamUsage());
+#else
+	printf("ring %u slots, %u-byte sequence, page %u, head index %s, pre-erase %s, shadow %s, crc %s, RAM %u bytes\n",
+	       BENCH_COUNT, BENCH_COUNT < 256 ? 1 : 2, EEPROM_HAL_PAGE_SIZE, EEPROM_USE_HEAD_INDEX ? "on" : "off",
+	       EEPROM_PRE_ERASE ? "on" : "off", EEPROM_USE_SHADOW ? "on" : "off", EEPROM_USE_CRC ? "on" : "off",
+	       EEPROM_GetRamUsage());
+#endif
+	printf("  %-30s %6s %12s %12s %14s\n", "call", "calls", "reads/call", "writes/call", "time/call, us");
+
+	bench_begin();
+	EEPROM_Mount();
+	bench_report("EEPROM_Mount", 1);
+
+	volatile uint32_t sink = 0;
+	bench_begin();
+	for (uint32_t i = 0; i < BENCH_CALLS; i++)
+		sink += EEPROM_ReadWearLeveledByte(BENCH_BYTE);
+	bench_report("EEPROM_ReadWearLeveledByte", BENCH_CALLS);
+
+	bench_begin();
+	for (uint32_t i = 0; i < BENCH_CALLS; i++)
+		sink += EEPROM_ReadWearLeveledWord(BENCH_WORD);
+	bench_report("EEPROM_ReadWearLeveledWord", BENCH_CALLS);
+
+	bench_begin();
+	for (uint32_t i = 0; i < BENCH_CALLS; i++) {
+		uint32_t block;
+		EEPROM_ReadWearLeveled(BENCH_BLOCK, block);
+		sink += block;
+	}
+	bench_report("EEPROM_ReadWearLeveledBlock", BENCH_CALLS);
+
+	// Постановка в очередь и запись в фоне замеряются раздельно
+	eeprom_sim_stats_t queue_cost;
+	memset(&queue_cost, 0, sizeof(queue_cost));
+	bench_begin();
+	for (uint32_t i = 0; i < BENCH_CALLS; i++) {
+		eeprom_sim_stats_t before = *eeprom_sim_stats();
+		value = bench_next(value);
+		EEPROM_WriteWearLeveled(BENCH_BLOCK, &value);
+		queue_cost.reads += eeprom_sim_stats()->reads - before.reads;
+		queue_cost.time_ns += eeprom_sim_stats()->time_ns - before.time_ns;
+		bench_flush();
+		eeprom_sim_run_until_idle();
+	}
+	const eeprom_sim_stats_t *now = eeprom_sim_stats();
+	printf("  %-30s %6u %12.2f %12.2f %14.3f\n", "EEPROM_WriteWearLeveled", BENCH_CALLS,
+	       (double)queue_cost.reads / BENCH_CALLS, 0.0, (double)queue_cost.time_ns / BENCH_CALLS / 1000.0);
+	printf("  %-30s %6u %12.2f %12.2f %14.3f\n", "  background write", BENCH_CALLS,
+	       (double)(now->reads - bench_start.reads - queue_cost.reads) / BENCH_CALLS,
+	       (double)(now->programs - bench_start.programs) / BENCH_CALLS,
+	       (double)(now->time_ns - bench_start.time_ns - queue_cost.time_ns) / BENCH_CALLS / 1000.0);
+#if EEPROM_HAL_PAGE_SIZE
+	// Внешняя EEPROM: байты элемента в одной странице записываются одной командой
+	uint32_t pages = now->pages - bench_start.pages;
+	printf("  %-30s %.2f pages, %.1f bytes/page, save %.1f us\n", "    page programs/call",
+	       (double)pages / BENCH_CALLS, pages ? (double)(now->programs - bench_start.programs) / pages : 0.0,
+	       (double)(pages * EEPROM_SIM_PAGE_NS) / BENCH_CALLS / 1000.0);
+#if EEPROM_USE_LOG
+	// Записи журнала из одного банка на одной странице программируются одной командой: три записи
+	// занимают не больше двух страниц (журнал в одну страницу не объединяется)
+	uint32_t batch_pages = now->pages;
+	uint8_t batch_byte = 0;
+	uint16_t batch_word = 0;
+	for (uint32_t i = 0; i < BENCH_CALLS; i++) {
+		value = bench_next(value);
+		batch_byte = (uint8_t)value;
+		batch_word = (uint16_t)(value >> 8);
+		EEPROM_WriteWearLeveled(BENCH_BYTE, &batch_byte);
+		EEPROM_WriteWearLeveled(BENCH_WORD, &batch_word);
+		EEPROM_WriteWearLeveled(BENCH_BLOCK, &value);
+		EEPROM_Flush();
+		eeprom_sim_run_until_idle();
+	}
+	batch_pages = now->pages - batch_pages;
+	printf("  %-30s %.2f pages per 3 records\n", "    batched log records", (double)batch_pages / BENCH_CALLS);
+	if (BENCH_COUNT > EEPROM_PAGE_SLOTS(EEPROM_LOG_RECORD_SIZE) && batch_pages > 2 * BENCH_CALLS) {
+		fprintf(stderr, "log records of one bank on the same page were programmed separately\n");
+		return 1;
+	}
+	cold_value = batch_byte;  // Дальше BENCH_BYTE не меняется
+	EEPROM_Mount();
+	uint32_t batch_block;
+	EEPROM_ReadWearLeveled(BENCH_BLOCK, batch_block);
+	if (EEPROM_ReadWearLeveledByte(BENCH_BYTE) != batch_byte || EEPROM_ReadWearLeveledWord(BENCH_WORD) != batch_word
+	    || batch_block != value) {
+		fprintf(stderr, "batched log records were not written\n");
+		return 1;
+	}
+#endif
+#else
+	// Стирание выполняется в свободное время, на время сохранения параметра влияют только циклы записи
+	uint32_t erase_writes = now->erase_writes - bench_start.erase_writes;
+	uint32_t writes = now->writes - bench_start.writes;
+	uint32_t erases = now->erases - bench_start.erases;
+	printf("  %-30s erase+write %.2f, write-only %.2f, erase-only %.2f\n", "    cycles/call",
+	       (double)erase_writes / BENCH_CALLS, (double)writes / BENCH_CALLS, (double)erases / BENCH_CALLS);
+	printf("  %-30s save %.1f us, idle erase %.1f us\n", "    programming/call",
+	       (double)(erase_writes * EEPROM_SIM_ERASE_WRITE_NS + writes * EEPROM_SIM_WRITE_NS) / BENCH_CALLS / 1000.0,
+	       (double)(erases * EEPROM_SIM_ERASE_NS) / BENCH_CALLS / 1000.0);
+#endif
+
+	// Частые изменения одного параметра (вращение ручки): новое значение каждые 5 мс, пока идет запись
+	// предыдущих. Повторные записи объединяются, последнее значение не должно потеряться
+	bench_begin();
+	for (uint32_t i = 0; i < BENCH_CALLS; i++) {
+		value = bench_next(value);
+		uint16_t word = value;
+		EEPROM_WriteWearLeveled(BENCH_WORD, &word);
+		StartWriteBuffer();
+		eeprom_sim_run(5000000ULL);
+		if (i % (BENCH_TICK_MS / 5) == 0)
+			EEPROM_Tick();
+	}
+	// Ждем окончания затишья
+	for (uint32_t i = 0; i < 2 * BENCH_QUIET_TICKS; i++) {
+		EEPROM_Tick();
+		eeprom_sim_run(BENCH_TICK_MS * 1000000ULL);
+	}
+	eeprom_sim_run_until_idle();
+	bench_report("burst, 5 ms apart", BENCH_CALLS);
+	if (EEPROM_ReadWearLeveledWord(BENCH_WORD) != (uint16_t)value) {
+		fprintf(stderr, "last value of the burst was lost\n");
+		return 1;
+	}
+
+#if EEPROM_USE_STATS
+	// Все записи BENCH_BLOCK шли с чистой EEPROM и без объединения, поэтому сумма оценок износа
+	// элементов равна количеству записанных элементов
+	eeprom_param_stats_t param_stats;
+	eeprom_stats_t stats;
+	EEPROM_GetStats(&stats);
+	printf("  stats: queue peak %u, isr %u calls, %.1f cycles avg, %u max, lookups %u, %.1f cycles avg\n",
+	       stats.queue_peak, stats.isr_calls, (double)stats.isr_cycles / stats.isr_calls, stats.isr_cycles_max,
+	       stats.lookups, stats.lookups ? (double)stats.lookup_cycles / stats.lookups : 0.0);
+	for (uint8_t index = 0; index < BENCH_PARAMS; index++) {
+		uint32_t wear = 0, wear_max = 0;
+		for (uint16_t slot = 0; slot < BENCH_COUNT; slot++) {
+			uint32_t slot_wear = EEPROM_EstimateWear(index, slot, NULL);
+			wear += slot_wear;
+			if (slot_wear > wear_max)
+				wear_max = slot_wear;
+		}
+		EEPROM_GetParamStats(index, &param_stats);
+		printf("  param %u: requested %u, skipped %u, dropped %u, programmed %u bytes, records %u, slot wear max %u\n",
+		       index, param_stats.requested, param_stats.skipped, param_stats.dropped, param_stats.programmed, wear, wear_max);
+		if (!EEPROM_USE_LOG && index == BENCH_BLOCK && wear != (uint32_t)(param_stats.requested - param_stats.skipped - param_stats.dropped)) {
+			fprintf(stderr, "wear estimate does not match the number of records\n");
+			return 1;
+		}
+	}
+
+#if !EEPROM_USE_LOG
+	// Через период НОК записей статус и текущий элемент BENCH_BLOCK повторяются и оценка по статусам
+	// не изменилась бы: записи, посчитанные с запуска, добавляют ровно один период
+	// Размер статуса - как BENCH_SEQ в bench_layout.h
+	uint32_t modulus = BENCH_COUNT < 256 ? 0x100UL : 0x10000UL;
+	uint32_t gcd = modulus, rest = BENCH_COUNT;
+	while (rest) {
+		uint32_t t = gcd % rest;
+		gcd = rest;
+		rest = t;
+	}
+	uint32_t period = modulus / gcd * BENCH_COUNT;
+	if (period <= BENCH_WEAR_PERIOD_MAX) {
+		uint32_t wear_before = 0, wear_after = 0;
+		uint8_t bound_before = 0, bound_after = 0;
+		for (uint16_t slot = 0; slot < BENCH_COUNT; slot++)
+			wear_before += EEPROM_EstimateWear(BENCH_BLOCK, slot, &bound_before);
+		for (uint32_t i = 0; i < period; i++)
+			bench_write(BENCH_BLOCK, value = bench_next(value));
+		for (uint16_t slot = 0; slot < BENCH_COUNT; slot++)
+			wear_after += EEPROM_EstimateWear(BENCH_BLOCK, slot, &bound_after);
+		printf("  wear estimate: +%u records over a period of %u writes, lower bound %u\n",
+		       wear_after - wear_before, period, bound_after);
+		if (wear_after - wear_before != period || bound_before || !bound_after) {
+			fprintf(stderr, "wear estimate wrapped around the sequence period\n");
+			return 1;
+		}
+	}
+#endif
+#endif
+
+#if EEPROM_USE_SHADOW
+	eeprom_shadow_stats_t shadow;
+	EEPROM_GetShadowStats(&shadow);
+	printf("  shadow: writes %u, merged %u, flushed on quiet %u, on age %u, explicit %u, deferred %u\n",
+	       shadow.writes, shadow.merged, shadow.flush_quiet, shadow.flush_age, shadow.flush_explicit, shadow.deferred);
+#endif
+
+#if EEPROM_USE_GOVERNOR
+	// Ограничитель износа: BENCH_BLOCK меняется и сбрасывается (EEPROM_Flush()) на каждом тике в течение
+	// BENCH_GOVERNOR_INTERVALS интервалов. Записывается не больше EEPROM_GOVERNOR_BURST + BENCH_GOVERNOR_INTERVALS
+	// элементов, поэтому самая изношенная ячейка EEPROM получает не больше циклов, чем на столько кругов буфера.
+	// Последнее значение остается в кэше и записывается, когда бюджет восстановится
+	static uint32_t wear_before[65536];
+	eeprom_write_budget_t write_budget;
+	uint32_t expected_interval = (uint32_t)(((EEPROM_GOVERNOR_LIFETIME_DAYS * 86400000ULL / EEPROM_GOVERNOR_TICK_MS
+	                              + EEPROM_GOVERNOR_ENDURANCE - 1) / EEPROM_GOVERNOR_ENDURANCE + BENCH_COUNT - 1) / BENCH_COUNT);
+	uint32_t held_ticks = 0;
+
+	eeprom_sim_run_until_idle();
+	do {
+		EEPROM_Tick();
+		EEPROM_GetWriteBudget(BENCH_BLOCK, &write_budget);
+	} while (write_budget.available < EEPROM_GOVERNOR_BURST);
+	if (write_budget.interval != expected_interval || write_budget.wait != 0 || write_budget.held) {
+		fprintf(stderr, "governor interval %u instead of %u\n", write_budget.interval, expected_interval);
+		return 1;
+	}
+	memcpy(wear_before, eeprom_sim_wear(), sizeof(wear_before));
+
+	uint32_t ticks = BENCH_GOVERNOR_INTERVALS * write_budget.interval;
+	for (uint32_t tick = 0; tick < ticks; tick++) {
+		value = bench_next(value);
+		EEPROM_WriteWearLeveled(BENCH_BLOCK, &value);
+		EEPROM_Flush();
+		eeprom_sim_run(BENCH_TICK_MS * 1000000ULL);
+		EEPROM_Tick();
+		EEPROM_GetWriteBudget(BENCH_BLOCK, &write_budget);
+		held_ticks += write_budget.held;
+	}
+	eeprom_sim_run_until_idle();
+
+	uint32_t hottest = 0;
+	for (uint32_t address = 0; address < 65536; address++)
+		if (eeprom_sim_wear()[address] - wear_before[address] > hottest)
+			hottest = eeprom_sim_wear()[address] - wear_before[address];
+	uint32_t limit = (EEPROM_GOVERNOR_BURST + BENCH_GOVERNOR_INTERVALS + BENCH_COUNT - 1) / BENCH_COUNT + 1;
+	printf("  governor: interval %u ticks, %u changes, held for %u ticks, hottest cell +%u cycles (limit %u)\n",
+	       write_budget.interval, ticks, held_ticks, hottest, limit);
+	if (hottest > limit || (write_budget.interval > 1 && held_ticks == 0)) {
+		fprintf(stderr, "governor did not limit the write rate\n");
+		return 1;
+	}
+
+	// Бюджет восстанавливается, и последнее значение записывается без новых вызовов записи
+	for (uint32_t tick = 0; tick <= write_budget.interval + 2 * BENCH_QUIET_TICKS; tick++) {
+		EEPROM_Tick();
+		eeprom_sim_run(BENCH_TICK_MS * 1000000ULL);
+		EEPROM_GetWriteBudget(BENCH_BLOCK, &write_budget);
+	}
+	eeprom_sim_run_until_idle();
+	EEPROM_Mount();
+	uint32_t governed;
+	EEPROM_ReadWearLeveled(BENCH_BLOCK, governed);
+	if (write_budget.held || governed != value) {
+		fprintf(stderr, "held value was not written when the write_budget recovered\n");
+		return 1;
+	}
+	// После сброса бюджет израсходован: следующая запись - не раньше чем через интервал
+	EEPROM_GetWriteBudget(BENCH_BLOCK, &write_budget);
+	if (write_budget.available != 0 || write_budget.wait != write_budget.interval) {
+		fprintf(stderr, "governor budget was not spent after a reset (%u writes available)\n", write_budget.available);
+		return 1;
+	}
+
+	// Выключение сразу после изменений: EEPROM_Flush() оставляет значение без бюджета в кэше,
+	// EEPROM_ForceFlush() записывает его в долг и учитывает перерасход
+	eeprom_shadow_stats_t shadow_before, shadow_after;
+	EEPROM_GetShadowStats(&shadow_before);
+	for (uint8_t i = 0; i <= EEPROM_GOVERNOR_BURST; i++) {
+		value = bench_next(value);
+		EEPROM_WriteWearLeveled(BENCH_BLOCK, &value);
+		EEPROM_Flush();
+		eeprom_sim_run_until_idle();
+	}
+	EEPROM_GetWriteBudget(BENCH_BLOCK, &write_budget);
+	uint8_t held = write_budget.held;
+	EEPROM_ForceFlush();
+	eeprom_sim_run_until_idle();
+	EEPROM_GetShadowStats(&shadow_after);
+	EEPROM_GetWriteBudget(BENCH_BLOCK, &write_budget);
+	EEPROM_Mount();
+	EEPROM_ReadWearLeveled(BENCH_BLOCK, governed);
+	printf("  governor: forced flush wrote %u held value(s) over budget\n", shadow_after.overdraft - shadow_before.overdraft);
+	if (!held || write_budget.held || governed != value || shadow_after.overdraft != shadow_before.overdraft + 1) {
+		fprintf(stderr, "forced flush did not write the held value\n");
+		return 1;
+	}
+
+	// Значение, вернувшееся к записанному, передается без новой записи и бюджет не тратит
+	eeprom_write_budget_t budget_before;
+	uint32_t restored = value;
+	EEPROM_GetWriteBudget(BENCH_BLOCK, &budget_before);
+	value = bench_next(value);
+	EEPROM_WriteWearLeveled(BENCH_BLOCK, &value);
+	EEPROM_WriteWearLeveled(BENCH_BLOCK, &restored);
+	value = restored;
+	EEPROM_ForceFlush();
+	eeprom_sim_run_until_idle();
+	EEPROM_GetWriteBudget(BENCH_BLOCK, &write_budget);
+	if (write_budget.held || write_budget.wait != budget_before.wait) {
+		fprintf(stderr, "unchanged value spent the write budget (wait %u instead of %u)\n", write_budget.wait, budget_before.wait);
+		return 1;
+	}
+#endif
+
+	// Вытеснение: прерывание готовности приходит посреди вызовов API - при каждом чтении EEPROM,
+	// опросе готовности и выходе из критической секции. Чтение сразу после записи возвращает новое
+	// значение (неблокирующее - новое или ничего), после монтирования остаются последние значения
+	uint32_t preempt_calls = eeprom_sim_stats()->preemptions;
+	uint16_t preempt_word = 0;
+	eeprom_sim_preempt(1);
+	for (uint32_t i = 0; i < BENCH_CALLS; i++) {
+		uint32_t block;
+		uint16_t word;
+		value = bench_next(value);
+		preempt_word = (uint16_t)(value >> 8);
+		EEPROM_WriteWearLeveled(BENCH_WORD, &preempt_word);
+		EEPROM_WriteWearLeveled(BENCH_BLOCK, &value);
+		if (i % 3 == 0)
+			bench_flush();
+		EEPROM_ReadWearLeveled(BENCH_BLOCK, block);
+		word = EEPROM_ReadWearLeveledWord(BENCH_WORD);
+		if (block != value || word != preempt_word
+		    || (EEPROM_TryReadWearLeveled(BENCH_BLOCK, block) && block != value)) {
+			fprintf(stderr, "read during preemption returned an old value\n");
+			return 1;
+		}
+		eeprom_sim_run(BENCH_TICK_MS * 1000000ULL / 20);
+	}
+	bench_flush();
+	eeprom_sim_preempt(0);
+	eeprom_sim_run_until_idle();
+	preempt_calls = eeprom_sim_stats()->preemptions - preempt_calls;
+	printf("  preemption: %u interrupts inside API calls\n", preempt_calls);
+	EEPROM_Mount();
+	uint32_t preempt_block;
+	EEPROM_ReadWearLeveled(BENCH_BLOCK, preempt_block);
+	if (preempt_calls == 0 || preempt_block != value || EEPROM_ReadWearLeveledWord(BENCH_WORD) != preempt_word) {
+		fprintf(stderr, "values written during preemption were lost\n");
+		return 1;
+	}
+
+#if EEPROM_RECOVERY || EEPROM_USE_LOG
+	// Сброс во время записи элемента: через каждую миллисекунду от начала записи снимаем копию EEPROM
+	// (программируемые в этот момент байты портятся), дописываем элемент, возвращаем копию и монтируем
+	// заново. Пока статус не записан, параметр должен откатываться к предыдущему значению.
+	// Проверяется несколько элементов подряд, чтобы попасть и на переход через конец кольцевого буфера
+	static uint8_t torn[65536];
+	uint32_t crashes = 0;
+#if EEPROM_RECOVERY
+	uint32_t repairs = 0;
+#endif
+	for (uint32_t record = 0, ms = 0; record < BENCH_CRASH_RECORDS; ms++) {
+		uint32_t old_value, block;
+		EEPROM_ReadWearLeveled(BENCH_BLOCK, old_value);
+		value = bench_next(value);
+		EEPROM_WriteWearLeveled(BENCH_BLOCK, &value);
+		bench_flush();
+
+		eeprom_sim_run(ms * 1000000ULL);
+		memcpy(torn, eeprom_sim_memory(), sizeof(torn));
+		for (uint8_t i = 0; eeprom_sim_programming() >= 0 && i < eeprom_sim_programming_size(); i++)
+			torn[eeprom_sim_programming() + i] = (uint8_t)bench_next(ms + i);
+		eeprom_sim_run_until_idle();
+		memcpy(eeprom_sim_memory(), torn, sizeof(torn));
+		EEPROM_Mount();
+#if EEPROM_RECOVERY
+		repairs += EEPROM_GetRepairCount();
+#endif
+		crashes++;
+
+		EEPROM_ReadWearLeveled(BENCH_BLOCK, block);
+		if (block == value) {
+			record++;
+			ms = 0;
+			continue;
+		}
+		if (block != old_value || ms > 100) {
+			fprintf(stderr, "reset %u ms into a record was not recovered\n", ms);
+			return 1;
+		}
+	}
+#if EEPROM_RECOVERY
+	printf("  crash recovery: %u resets during a record, %u statuses repaired\n", crashes, repairs);
+#else
+	printf("  crash recovery: %u resets during a record\n", crashes);
+#endif
+#endif
+
+	// Чтение в цикле управления во время сохранения: каждые 250 мкс, пока записывается BENCH_BLOCK.
+	// Записываемое значение читается из буфера записи сразу после вызова записи, неблокирующее чтение
+	// не ждет окончания программирования ни для записываемого, ни для других параметров. Со значениями
+	// в ОЗУ (EEPROM_USE_READ_CACHE, EEPROM_USE_SHADOW) не ждет и обычное чтение
+	uint32_t tries = 0, deferred = 0, try_stalls = 0, read_stalls = 0;
+	uint16_t idle_word = EEPROM_ReadWearLeveledWord(BENCH_WORD);
+	for (uint32_t save = 0; save < BENCH_CRASH_RECORDS; save++) {
+		value = bench_next(value);
+		EEPROM_WriteWearLeveled(BENCH_BLOCK, &value);
+		bench_flush();
+		for (uint32_t step = 0; step < 200; step++) {
+			uint32_t stalls = eeprom_sim_stats()->stalls, block = value;
+			uint16_t word = idle_word;
+			// После записи элемента EEPROM может быть занята стиранием (EEPROM_PRE_ERASE) - чтение откладывается
+			uint8_t forwarded = EEPROM_TryReadWearLeveled(BENCH_BLOCK, block);
+			if ((step == 0 && !forwarded) || block != value) {
+				fprintf(stderr, "pending value was not forwarded from the write buffer\n");
+				return 1;
+			}
+			deferred += !forwarded;
+			if (!EEPROM_TryReadWearLeveled(BENCH_WORD, word))
+				deferred++;
+			tries += 2;
+			try_stalls += eeprom_sim_stats()->stalls - stalls;
+			stalls = eeprom_sim_stats()->stalls;
+			if (word != idle_word || EEPROM_ReadWearLeveledWord(BENCH_WORD) != idle_word) {
+				fprintf(stderr, "read during a save returned %04x instead of %04x\n", word, idle_word);
+				return 1;
+			}
+			EEPROM_ReadWearLeveled(BENCH_BLOCK, block);
+			if (block != value) {
+				fprintf(stderr, "blocking read during a save returned a stale value\n");
+				return 1;
+			}
+			read_stalls += eeprom_sim_stats()->stalls - stalls;
+			eeprom_sim_run(250000ULL);
+		}
+		eeprom_sim_run_until_idle();
+	}
+	printf("  reads during a save: %u non-blocking reads, %u deferred while busy, %u stalls; %u blocking read stalls\n",
+	       tries, deferred, try_stalls, read_stalls);
+	if (try_stalls != 0) {
+		fprintf(stderr, "non-blocking read waited for programming\n");
+		return 1;
+	}
+#if EEPROM_USE_READ_CACHE || EEPROM_USE_SHADOW
+	if (deferred != 0 || read_stalls != 0) {
+		fprintf(stderr, "read with values in RAM waited for programming\n");
+		return 1;
+	}
+#endif
+
+#if EEPROM_USE_EMERGENCY
+	// Пропадание питания с полным буфером: BENCH_BYTE и BENCH_WORD поставлены в очередь раньше BENCH_BLOCK,
+	// но времени удержания хватает только на элемент BENCH_BLOCK, и он записывается по приоритету
+	eeprom_emergency_report_t emergency;
+	uint8_t old_byte = EEPROM_ReadWearLeveledByte(BENCH_BYTE), new_byte = old_byte ^ 0x5A;
+	uint16_t old_word = EEPROM_ReadWearLeveledWord(BENCH_WORD), new_word = old_word ^ 0x5A5A;
+	// Наихудшая оценка элемента BENCH_BLOCK, для журнала - с переносом записи из хвоста
+	uint32_t block_programs = EEPROM_USE_LOG ? (EEPROM_HAL_PAGE_SIZE ? 2 : 2 * EEPROM_LOG_RECORD_SIZE)
+	                        : EEPROM_HAL_PAGE_SIZE ? 1 : 4 + (BENCH_COUNT < 256 ? 1 : 2) + EEPROM_CRC_SIZE;
+	uint16_t budget = block_programs * EEPROM_EMERGENCY_PROGRAM_US + EEPROM_EMERGENCY_PROGRAM_US / 2;
+	value = bench_next(value);
+	EEPROM_WriteWearLeveled(BENCH_BYTE, &new_byte);
+	EEPROM_WriteWearLeveled(BENCH_WORD, &new_word);
+	EEPROM_WriteWearLeveled(BENCH_BLOCK, &value);
+	EEPROM_EmergencyFlush(budget, &emergency);
+	printf("  emergency flush in %u us: %u written, %u dropped in %u us, %u us per program\n",
+	       budget, emergency.written, emergency.dropped, emergency.elapsed_us, emergency.program_us);
+	EEPROM_Mount();
+	uint32_t emergency_block;
+	EEPROM_ReadWearLeveled(BENCH_BLOCK, emergency_block);
+	// С заранее стертыми элементами BENCH_BLOCK пишется быстрее оценки, и короткий BENCH_BYTE тоже успевает
+	if (emergency.written + emergency.dropped != 3 || emergency.dropped_index[0] != BENCH_WORD
+	    || emergency.elapsed_us > budget || emergency_block != value || EEPROM_ReadWearLeveledWord(BENCH_WORD) != old_word
+	    || EEPROM_ReadWearLeveledByte(BENCH_BYTE) != (emergency.written == 2 ? new_byte : old_byte)) {
+		fprintf(stderr, "emergency flush did not write by priority within the budget\n");
+		return 1;
+	}
+	if (emergency.written == 2)
+		bench_write(BENCH_BYTE, old_byte);
+
+	// Пропадание питания во время записи элемента: он дописывается, затем пишется очередь
+	// (в журнале оценка записи так велика, что BENCH_BLOCK может не успеть)
+	uint32_t old_block = value;
+	budget = 3 * block_programs * EEPROM_EMERGENCY_PROGRAM_US > 0xFFFF ? 0xFFFF : 3 * block_programs * EEPROM_EMERGENCY_PROGRAM_US;
+	EEPROM_WriteWearLeveled(BENCH_WORD, &new_word);
+	bench_flush();
+	eeprom_sim_run(1000000ULL);
+	value = bench_next(value);
+	EEPROM_WriteWearLeveled(BENCH_BLOCK, &value);
+	EEPROM_EmergencyFlush(budget, &emergency);
+	EEPROM_Mount();
+	EEPROM_ReadWearLeveled(BENCH_BLOCK, emergency_block);
+	if (emergency.written + emergency.dropped != 1 || emergency.elapsed_us > budget
+	    || emergency_block != (emergency.dropped ? old_block : value) || EEPROM_ReadWearLeveledWord(BENCH_WORD) != new_word) {
+		fprintf(stderr, "emergency flush lost the element being written or the queue\n");
+		return 1;
+	}
+#endif
+
+#if EEPROM_USE_COUNTER
+	// Приращения по одному: в основном сброс битов без стирания, раз в 129 приращений - новая база
+	uint32_t counter = EEPROM_ReadCounter(BENCH_COUNTER);
+	bench_begin();
+	for (uint32_t i = 0; i < BENCH_CALLS; i++) {
+		EEPROM_IncrementCounter(BENCH_COUNTER);
+		bench_flush();
+		eeprom_sim_run_until_idle();
+		counter++;
+		if (i % 97 == 0)
+			EEPROM_Mount();
+		if (EEPROM_ReadCounter(BENCH_COUNTER) != counter) {
+			fprintf(stderr, "counter is %u after %u increments, expected %u\n", EEPROM_ReadCounter(BENCH_COUNTER), i + 1, counter);
+			return 1;
+		}
+	}
+	bench_report("EEPROM_IncrementCounter", BENCH_CALLS);
+
+	// Приращения, накопленные до записи, объединяются, запись значения счетчика игнорируется
+	for (uint32_t i = 0; i < 300; i++)
+		EEPROM_IncrementCounter(BENCH_COUNTER);
+	EEPROM_WriteWearLeveled(BENCH_COUNTER, &value);
+	bench_flush();
+	eeprom_sim_run_until_idle();
+	counter += 300;
+	EEPROM_Mount();
+	uint32_t counter_block = 0;
+	EEPROM_ReadWearLeveled(BENCH_COUNTER, counter_block);
+	if (EEPROM_ReadCounter(BENCH_COUNTER) != counter || counter_block != counter) {
+		fprintf(stderr, "batched increments were lost: %u instead of %u\n", EEPROM_ReadCounter(BENCH_COUNTER), counter);
+		return 1;
+	}
+#if EEPROM_RECOVERY
+	// Сброс во время записи новой базы (приращение больше области): после монтирования - прежнее
+	// или новое значение, но не промежуточное
+	uint32_t counter_crashes = 0;
+	for (uint32_t record = 0, ms = 0; record < BENCH_CRASH_RECORDS; ms++) {
+		uint32_t old_counter = EEPROM_ReadCounter(BENCH_COUNTER);
+		EEPROM_AddCounter(BENCH_COUNTER, 1000);
+		bench_flush();
+
+		eeprom_sim_run(ms * 1000000ULL);
+		memcpy(torn, eeprom_sim_memory(), sizeof(torn));
+		for (uint8_t i = 0; eeprom_sim_programming() >= 0 && i < eeprom_sim_programming_size(); i++)
+			torn[eeprom_sim_programming() + i] = (uint8_t)bench_next(ms + i);
+		eeprom_sim_run_until_idle();
+		memcpy(eeprom_sim_memory(), torn, sizeof(torn));
+		EEPROM_Mount();
+		counter_crashes++;
+
+		counter = EEPROM_ReadCounter(BENCH_COUNTER);
+		if ((counter != old_counter && counter != old_counter + 1000) || ms > 100) {
+			fprintf(stderr, "reset %u ms into a counter fold left %u (old %u)\n", ms, counter, old_counter);
+			return 1;
+		}
+		if (counter != old_counter) {
+			record++;
+			ms = 0;
+		}
+	}
+	printf("  counter: %u, %u resets during a new base\n", counter, counter_crashes);
+#else
+	printf("  counter: %u\n", counter);
+#endif
+#endif
+
+#if EEPROM_USE_TXN
+	// BENCH_WORD и BENCH_BLOCK одной транзакцией (на вызов - вся группа). Замер после проверки оценки
+	// износа: количество записей BENCH_BLOCK превысило бы период, в котором оценка однозначна
+	bench_begin();
+	for (uint32_t i = 0; i < BENCH_CALLS; i++) {
+		value = bench_next(value);
+		uint16_t word = value;
+		EEPROM_BeginTransaction();
+		EEPROM_WriteWearLeveled(BENCH_WORD, &word);
+		EEPROM_WriteWearLeveled(BENCH_BLOCK, &value);
+		EEPROM_Commit();
+		eeprom_sim_run_until_idle();
+	}
+	bench_report("transaction, word + block", BENCH_CALLS);
+
+	// Сброс во время записи группы: BENCH_WORD и BENCH_BLOCK пишутся одной транзакцией и после
+	// монтирования должны быть оба старыми или оба новыми
+	uint32_t group_crashes = 0, group_repairs = 0;
+	for (uint32_t group = 0, ms = 0; group < BENCH_CRASH_RECORDS; ms++) {
+		uint32_t old_value, block;
+		uint16_t old_word = EEPROM_ReadWearLeveledWord(BENCH_WORD), word;
+		EEPROM_ReadWearLeveled(BENCH_BLOCK, old_value);
+		value = bench_next(value);
+		uint16_t new_word = (uint16_t)value;
+		EEPROM_BeginTransaction();
+		EEPROM_WriteWearLeveled(BENCH_WORD, &new_word);
+		EEPROM_WriteWearLeveled(BENCH_BLOCK, &value);
+		if (!EEPROM_Commit()) {
+			fprintf(stderr, "transaction was not committed\n");
+			return 1;
+		}
+
+		eeprom_sim_run(ms * 1000000ULL);
+		memcpy(torn, eeprom_sim_memory(), sizeof(torn));
+		for (uint8_t i = 0; eeprom_sim_programming() >= 0 && i < eeprom_sim_programming_size(); i++)
+			torn[eeprom_sim_programming() + i] = (uint8_t)bench_next(ms + i);
+		eeprom_sim_run_until_idle();
+		memcpy(eeprom_sim_memory(), torn, sizeof(torn));
+		EEPROM_Mount();
+		group_repairs += EEPROM_GetRepairCount();
+		group_crashes++;
+
+		EEPROM_ReadWearLeveled(BENCH_BLOCK, block);
+		word = EEPROM_ReadWearLeveledWord(BENCH_WORD);
+		if ((!(block == value && word == new_word) && !(block == old_value && word == old_word)) || ms > 100) {
+			fprintf(stderr, "reset %u ms into a transaction left word %04x, block %08x (old %08x, new %08x)\n",
+			        ms, word, block, old_value, value);
+			return 1;
+		}
+		if (block == value) {
+			group++;
+			ms = 0;
+		}
+	}
+	printf("  transactions: %u resets during a group, %u statuses rolled forward or repaired\n", group_crashes, group_repairs);
+#endif
+
+	if (EEPROM_ReadWearLeveledByte(BENCH_BYTE) != cold_value) {
+		fprintf(stderr, "value of an unchanged parameter was lost\n");
+		return 1;
+	}
+
+	now = eeprom_sim_stats();
+	if (now->errors != 0) {
+		fprintf(stderr, "simulator reported %u protocol errors\n", now->errors);
+		return 1;
+	}
+	(void)sink;
+	return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * eeprom_bench_hpp.cpp
+ *
+ *  Author: https://github.com/AntonNeutron/EEPROM_WearLeveling
+ */
+
+/*
+  Те же параметры, что в eeprom_bench, описанные через eeprom.hpp: проверка при компиляции,
+  что размещение совпадает с таблицей скрипта (bench_layout.h), и сравнение шаблонов
+  чтения и записи с функциями C API на симуляторе EEPROM.
+*/
+
+#include <stdio.h>
+#include "eeprom.hpp"
+extern "C" {
+#include "eeprom_sim.h"
+}
+
+#ifndef BENCH_COUNT
+#define BENCH_COUNT 100
+#endif
+
+// Количество вызовов каждой функции при замере
+#ifndef BENCH_CALLS
+#define BENCH_CALLS 1000
+#endif
+
+struct BenchByte : eeprom::Param<uint8_t, BENCH_COUNT> {};
+struct BenchWord : eeprom::Param<uint16_t, BENCH_COUNT> {};
+struct BenchBlock : eeprom::Param<uint32_t, BENCH_COUNT> {};
+
+#if EEPROM_USE_LOG
+typedef eeprom::Layout<EEPROM_RING_BYTES(EEPROM_LOG_RECORD_SIZE, BENCH_COUNT), 0, BenchByte, BenchWord, BenchBlock> Bench;
+#elif EEPROM_USE_COUNTER
+struct BenchCounter : eeprom::Counter<BENCH_COUNT, 16> {};
+typedef eeprom::Layout<65535, EEPROM_TXN_AREA_SIZE, BenchByte, BenchWord, BenchBlock, BenchCounter> Bench;
+#else
+typedef eeprom::Layout<65535, EEPROM_TXN_AREA_SIZE, BenchByte, BenchWord, BenchBlock> Bench;
+#endif
+
+EEPROM_DEFINE_LAYOUT(Bench);
+
+// Размещение совпадает с bench_layout.h
+static_assert(Bench::index_of<BenchBlock>() == 2, "index");
+static_assert(Bench::addr<1>() == EEPROM_PAGE_ALIGN(EEPROM_TXN_AREA_SIZE + EEPROM_RING_BYTES(1 + BenchByte::seq + EEPROM_CRC_SIZE, BENCH_COUNT)), "BENCH_WORD_ADDR");
+static_assert(Bench::addr<2>() == EEPROM_PAGE_ALIGN(Bench::addr<1>() + EEPROM_RING_BYTES(2 + BenchWord::seq + EEPROM_CRC_SIZE, BENCH_COUNT)), "BENCH_BLOCK_ADDR");
+
+static eeprom_sim_stats_t bench_start;
+
+static void bench_begin(void) {
+	bench_start = *eeprom_sim_stats();
+}
+
+static void bench_report(const char *name, uint32_t calls) {
+	const eeprom_sim_stats_t *now = eeprom_sim_stats();
+
+	printf("  %-30s %6u %12.2f %12.2f %14.3f\n", name, calls,
+	       (double)(now->reads - bench_start.reads) / calls,
+	       (double)(now->programs - bench_start.programs) / calls,
+	       (double)(now->time_ns - bench_start.time_ns) / calls / 1000.0);
+}
+
+static uint32_t bench_next(uint32_t value) {
+	return value * 1103515245UL + 12345UL;
+}
+
+// Запуск записи: с ограничителем износа сначала проходят тики, за которые восстанавливается бюджет
+static void bench_flush(void) {
+#if EEPROM_USE_GOVERNOR
+	for (uint8_t index = 0; index < Bench::count; index++) {
+		eeprom_write_budget_t budget;
+		EEPROM_GetWriteBudget(index, &budget);
+		while (budget.wait--)
+			EEPROM_Tick();
+	}
+#endif
+	EEPROM_Flush();
+}
+
+// Чтение всех параметров шаблонами и через C API должно давать одно и то же
+static int bench_check(void) {
+	uint32_t block;
+
+	EEPROM_ReadWearLeveled(Bench::index_of<BenchBlock>(), block);
+	return Bench::read<BenchByte>() == EEPROM_ReadWearLeveledByte(Bench::index_of<BenchByte>())
+	    && Bench::read<BenchWord>() == EEPROM_ReadWearLeveledWord(Bench::index_of<BenchWord>())
+	    && Bench::read<BenchBlock>() == block;
+}
+
+int main(void) {
+	uint32_t value = 0;
+
+	if (eeprom_sim_init(NULL, 65536) != 0) {
+		fprintf(stderr, "eeprom_sim_init failed\n");
+		return 1;
+	}
+
+	// Заполняем буферы на полтора круга шаблонами записи
+	for (uint32_t i = 0; i < BENCH_COUNT + BENCH_COUNT / 2; i++) {
+		value = bench_next(value);
+		Bench::write<BenchByte>((uint8_t)value);
+		Bench::write<BenchWord>((uint16_t)value);
+		Bench::write<BenchBlock>(value);
+		bench_flush();
+		eeprom_sim_run_until_idle();
+	}
+
+	printf("C++ layout (eeprom.hpp), %u slots, %u params, RAM %u bytes\n",
+	       BENCH_COUNT, Bench::count, EEPROM_GetRamUsage());
+	printf("  %-30s %6s %12s %12s %14s\n", "call", "calls", "reads/call", "writes/call", "time/call, us");
+
+	bench_begin();
+	EEPROM_Mount();
+	bench_report("EEPROM_Mount", 1);
+	if (Bench::read<BenchBlock>() != value || !bench_check()) {
+		fprintf(stderr, "template and C API reads differ after mount\n");
+		return 1;
+	}
+
+	volatile uint32_t sink = 0;
+	bench_begin();
+	for (uint32_t i = 0; i < BENCH_CALLS; i++)
+		sink += Bench::read<BenchWord>();
+	bench_report("Bench::read<BenchWord>", BENCH_CALLS);
+
+	bench_begin();
+	for (uint32_t i = 0; i < BENCH_CALLS; i++)
+		sink += EEPROM_ReadWearLeveledWord(Bench::index_of<BenchWord>());
+	bench_report("EEPROM_ReadWearLeveledWord", BENCH_CALLS);
+
+	// Шаблон записи и функция C API пишут в одни и те же кольцевые буферы вперемешку
+	bench_begin();
+	for (uint32_t i = 0; i < BENCH_CALLS; i++) {
+		value = bench_next(value);
+		if (i & 1)
+			Bench::write<BenchBlock>(value);
+		else
+			EEPROM_WriteWearLeveled(Bench::index_of<BenchBlock>(), &value);
+		bench_flush();
+		// Пока значение записывается, оно читается из буфера записи
+		uint32_t pending = 0;
+		eeprom_sim_run(1000000ULL);
+		if (!Bench::try_read<BenchBlock>(pending) || pending != value) {
+			fprintf(stderr, "write %u was not forwarded from the write buffer\n", i);
+			return 1;
+		}
+		eeprom_sim_run_until_idle();
+		if (Bench::read<BenchBlock>() != value) {
+			fprintf(stderr, "write %u was not read back\n", i);
+			return 1;
+		}
+	}
+	bench_report("Bench::write<BenchBlock> + C", BENCH_CALLS);
+
+	EEPROM_Mount();
+	if (Bench::read<BenchBlock>() != value || !bench_check()) {
+		fprintf(stderr, "template and C API reads differ after remount\n");
+		return 1;
+	}
+
+#if EEPROM_USE_COUNTER
+	// Счетчик за новой базой: 129 приращений не помещаются в область из 16 байт
+	for (uint32_t i = 0; i < 300; i++) {
+		Bench::add<BenchCounter>();
+		bench_flush();
+		eeprom_sim_run_until_idle();
+	}
+	Bench::add<BenchCounter>(700);
+	bench_flush();
+	eeprom_sim_run_until_idle();
+	EEPROM_Mount();
+	if (Bench::read<BenchCounter>() != 1000 || EEPROM_ReadCounter(Bench::index_of<BenchCounter>()) != 1000) {
+		fprintf(stderr, "counter is %u instead of 1000\n", Bench::read<BenchCounter>());
+		return 1;
+	}
+#endif
+
+#if EEPROM_USE_GOVERNOR
+	eeprom_write_budget_t budget;
+	EEPROM_GetWriteBudget(Bench::index_of<BenchBlock>(), &budget);
+	if (Bench::budget<BenchBlock>().interval != budget.interval || budget.interval == 0) {
+		fprintf(stderr, "template and C API write budgets differ\n");
+		return 1;
+	}
+#endif
+
+	if (eeprom_sim_stats()->errors != 0) {
+		fprintf(stderr, "simulator reported %u protocol errors\n", eeprom_sim_stats()->errors);
+		return 1;
+	}
+	(void)sink;
+	return 0;
+}
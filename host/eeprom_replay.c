@@ -0,0 +1,614 @@
+/*
+ * eeprom_replay.c
+ *
+ *  Author: https://github.com/AntonNeutron/EEPROM_WearLeveling
+ */
+
+/*
+  Прогон записанной нагрузки (трассы вызовов EEPROM_WriteWearLeveled()) через библиотеку на
+  симуляторе EEPROM: износ ячеек по элементам кольцевых буферов, ячейка, которая выйдет из
+  строя первой, прогноз срока службы и подбор _COUNT таблицы под заданный срок и объем EEPROM.
+  Таблица параметров - файл EEPROM_LAYOUT_FILE (по умолчанию replay_layout.h, см. Makefile).
+
+  Трасса - текстовый файл, строка на вызов записи: <время, с> <индекс параметра> <значение>.
+  Значение - число (десятичное или 0x...), записывается младшими байтами вперед в element_size
+  байт параметра. Для параметра-счетчика (EEPROM_USE_COUNTER) значение - приращение.
+  Пустые строки и строки, начинающиеся с #, пропускаются. Время не убывает.
+
+  Срок службы считается линейно: трасса описывает период работы устройства (-p, по умолчанию
+  время последней записи), износ за период повторяется до исчерпания ресурса (-e циклов).
+  Нужное количество элементов буфера обратно пропорционально износу его самого нагруженного
+  элемента. При сбросах питания (-c) после каждой записи с заданной вероятностью копия EEPROM
+  снимается в случайный момент программирования, как в eeprom_bench, и монтируется заново:
+  значение каждого параметра должно быть одним из записанных ранее.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "eeprom.h"
+#include "eeprom_hal.h"
+#include "eeprom_sim.h"
+
+// Своя копия таблицы параметров: размеры и адреса для отчета (в eeprom.c таблица не экспортируется)
+#define param_eeprom replay_param
+#include EEPROM_LAYOUT_FILE
+#undef param_eeprom
+
+#define REPLAY_PARAMS (sizeof(replay_param) / sizeof(replay_param[0]))
+
+// Период вызова EEPROM_Tick() при кэше значений, мс (с ограничителем износа - его период)
+#define REPLAY_TICK_MS EEPROM_GOVERNOR_TICK_MS
+
+// Окно, в котором выбирается момент сброса после записи, мс
+#define REPLAY_CUT_WINDOW_MS 30
+
+// Секунд в году
+#define REPLAY_YEAR (365.25 * 86400.0)
+
+// Наименьшее количество элементов кольцевого буфера в подборе
+#define REPLAY_MIN_COUNT 2
+
+static struct {
+	double period;       // Период трассы, с
+	double years;        // Требуемый срок службы, лет
+	double endurance;    // Ресурс ячейки, циклов стирания
+	double cut_rate;     // Вероятность сброса после записи
+	uint32_t budget;     // Место под параметры от EEPROM_START_ADR, байт
+	uint32_t repeat;     // Сколько раз прогнать трассу
+	uint64_t seed;
+	uint8_t verbose;     // Износ каждого элемента
+} opt = {0.0, 10.0, 100000.0, 0.0, EEPROM_SIZE - EEPROM_START_ADR, 1, 1, 0};
+
+// Запись трассы
+typedef struct {
+	double time;
+	uint8_t index;
+	uint64_t value;
+} replay_entry_t;
+
+static replay_entry_t *trace;
+static size_t trace_len;
+
+// Записи трассы по параметрам
+static uint32_t param_writes[REPLAY_PARAMS];
+
+// Замеры износа области (кольцевого буфера, областей приращений счетчика, журнала)
+typedef struct {
+	uint32_t max;      // Износ самой нагруженной ячейки
+	uint32_t min;      // Износ наименее нагруженного элемента (по его самой нагруженной ячейке)
+	uint32_t address;  // Адрес самой нагруженной ячейки
+	uint32_t slot;     // Ее элемент
+} replay_wear_t;
+
+static uint64_t replay_rand_state;
+
+static uint32_t replay_rand(void) {
+	replay_rand_state = replay_rand_state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (uint32_t)(replay_rand_state >> 33);
+}
+
+/******************************************************************************************************************************************************************/
+/*                                                                Значения, записанные в параметры                                                                */
+/******************************************************************************************************************************************************************/
+
+// Множество хешей (индекс, значение) всех записанных значений: после сброса параметр
+// может откатиться к любому из них, но не может содержать значение, которое не записывалось
+static uint64_t *seen;
+static size_t seen_cap, seen_used;
+
+static uint64_t replay_hash(uint8_t index, const uint8_t *data, uint8_t size) {
+	uint64_t hash = 14695981039346656037ULL ^ index;
+
+	for (uint8_t i = 0; i < size; i++)
+		hash = (hash ^ data[i]) * 1099511628211ULL;
+	return hash ? hash : 1;  // 0 - пустая ячейка
+}
+
+static int replay_seen(uint64_t hash) {
+	for (size_t i = hash % seen_cap; seen[i]; i = (i + 1) % seen_cap)
+		if (seen[i] == hash)
+			return 1;
+	return 0;
+}
+
+static void replay_remember(uint64_t hash) {
+	if (seen_used * 2 >= seen_cap) {
+		uint64_t *old = seen;
+		size_t old_cap = seen_cap;
+
+		seen_cap = seen_cap ? seen_cap * 2 : 1024;
+		seen = calloc(seen_cap, sizeof(seen[0]));
+		if (seen == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+		seen_used = 0;
+		for (size_t i = 0; i < old_cap; i++)
+			if (old[i])
+				replay_remember(old[i]);
+		free(old);
+	}
+	size_t i = hash % seen_cap;
+	for (; seen[i]; i = (i + 1) % seen_cap)
+		if (seen[i] == hash)
+			return;
+	seen[i] = hash;
+	seen_used++;
+}
+
+static uint8_t replay_is_counter(uint8_t index) {
+#if EEPROM_USE_COUNTER
+	return replay_param[index].counter != 0;
+#else
+	(void)index;
+	return 0;
+#endif
+}
+
+// Значение в element_size байт параметра, младшими байтами вперед
+static void replay_value(uint8_t index, uint64_t value, uint8_t *data) {
+	memset(data, 0, replay_param[index].element_size);
+	for (uint8_t i = 0; i < replay_param[index].element_size && i < sizeof(value); i++)
+		data[i] = (uint8_t)(value >> (8 * i));
+}
+
+// Запоминает текущие значения параметров (после монтирования) как допустимые
+static void replay_remember_current(void) {
+	uint8_t data[256];
+
+	for (uint8_t index = 0; index < REPLAY_PARAMS; index++) {
+		if (replay_is_counter(index))
+			continue;
+		EEPROM_ReadWearLeveledBlock(index, data, replay_param[index].element_size);
+		replay_remember(replay_hash(index, data, replay_param[index].element_size));
+	}
+}
+
+// Количество параметров, значение которых после монтирования никогда не записывалось
+static uint32_t replay_check_current(void) {
+	uint8_t data[256];
+	uint32_t torn = 0;
+
+	for (uint8_t index = 0; index < REPLAY_PARAMS; index++) {
+		if (replay_is_counter(index))
+			continue;
+		EEPROM_ReadWearLeveledBlock(index, data, replay_param[index].element_size);
+		torn += !replay_seen(replay_hash(index, data, replay_param[index].element_size));
+	}
+	return torn;
+}
+
+/******************************************************************************************************************************************************************/
+/*                                                                      Трасса и прогон                                                                           */
+/******************************************************************************************************************************************************************/
+
+static int replay_load(const char *path) {
+	FILE *file = fopen(path, "r");
+	char line[256];
+	size_t cap = 0;
+	uint32_t number = 0;
+
+	if (file == NULL) {
+		perror(path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), file) != NULL) {
+		char *p = line, *end;
+		replay_entry_t entry;
+
+		number++;
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0')
+			continue;
+
+		entry.time = strtod(p, &end);
+		int valid = end != p;
+		unsigned long index = strtoul(p = end, &end, 0);
+		valid &= end != p;
+		entry.value = strtoull(p = end, &end, 0);
+		valid &= end != p;
+		if (!valid || index >= REPLAY_PARAMS || entry.time < 0
+		    || (trace_len && entry.time < trace[trace_len - 1].time)) {
+			fprintf(stderr, "%s:%u: expected '<time, s> <index below %u> <value>' with non-decreasing time\n",
+			        path, number, (unsigned)REPLAY_PARAMS);
+			fclose(file);
+			return -1;
+		}
+		entry.index = (uint8_t)index;
+
+		if (trace_len == cap) {
+			cap = cap ? cap * 2 : 1024;
+			trace = realloc(trace, cap * sizeof(trace[0]));
+			if (trace == NULL) {
+				fprintf(stderr, "out of memory\n");
+				fclose(file);
+				return -1;
+			}
+		}
+		trace[trace_len++] = entry;
+	}
+	fclose(file);
+	return 0;
+}
+
+// Продвигает симулированное время до момента ns. С кэшем значений по пути вызывается EEPROM_Tick()
+static void replay_run_to(uint64_t ns) {
+	uint64_t now = eeprom_sim_stats()->time_ns;
+
+#if EEPROM_USE_SHADOW
+	// Через EEPROM_SHADOW_MAX_AGE тиков кэш записан целиком, дальше тики ничего не меняют.
+	// Ограничитель износа пополняет бюджет на каждом тике, поэтому с ним тики идут до конца промежутка
+	for (uint32_t tick = 0; (EEPROM_USE_GOVERNOR || tick <= EEPROM_SHADOW_MAX_AGE) && now + REPLAY_TICK_MS * 1000000ULL <= ns; tick++) {
+		eeprom_sim_run(REPLAY_TICK_MS * 1000000ULL);
+		EEPROM_Tick();
+		now = eeprom_sim_stats()->time_ns;
+	}
+#endif
+	if (ns > now)
+		eeprom_sim_run(ns - now);
+}
+
+// Сброс питания в случайный момент окна после записи: копия EEPROM с испорченными программируемыми
+// байтами, библиотека дописывает буфер (ее состояние в ОЗУ теряется), копия возвращается вместе
+// с износом и монтируется заново. Возвращает количество параметров с никогда не записанным значением
+static uint32_t replay_power_cut(void) {
+	static uint8_t torn[65536];
+	static uint32_t wear[65536];
+
+	eeprom_sim_run((uint64_t)(replay_rand() % (REPLAY_CUT_WINDOW_MS * 1000)) * 1000ULL);
+	memcpy(torn, eeprom_sim_memory(), EEPROM_SIZE);
+	memcpy(wear, eeprom_sim_wear(), EEPROM_SIZE * sizeof(wear[0]));
+	for (uint8_t i = 0; eeprom_sim_programming() >= 0 && i < eeprom_sim_programming_size(); i++)
+		torn[eeprom_sim_programming() + i] = (uint8_t)replay_rand();
+	eeprom_sim_run_until_idle();
+	memcpy(eeprom_sim_memory(), torn, EEPROM_SIZE);
+	memcpy(eeprom_sim_wear(), wear, EEPROM_SIZE * sizeof(wear[0]));
+	EEPROM_Mount();
+
+	uint32_t torn_params = replay_check_current();
+	// Значения, исправленные или откатанные при монтировании, допустимы дальше
+	replay_remember_current();
+	return torn_params;
+}
+
+/******************************************************************************************************************************************************************/
+/*                                                                          Отчет                                                                                 */
+/******************************************************************************************************************************************************************/
+
+// Износ ячеек size байт с адреса base
+static replay_wear_t replay_cells_wear(uint32_t base, uint32_t size) {
+	const uint32_t *cells = eeprom_sim_wear();
+	replay_wear_t wear = {0, 0, base, 0};
+
+	for (uint32_t address = base; address < base + size; address++) {
+		if (cells[address] > wear.max) {
+			wear.max = cells[address];
+			wear.address = address;
+		}
+	}
+	wear.min = wear.max;
+	return wear;
+}
+
+// Износ области из slots элементов размером stride байт с адреса base
+static replay_wear_t replay_region_wear(uint32_t base, uint32_t stride, uint32_t slots) {
+	replay_wear_t wear = {0, UINT32_MAX, base, 0};
+
+	for (uint32_t slot = 0; slot < slots; slot++) {
+		replay_wear_t element = replay_cells_wear(EEPROM_RING_ADDRESS(base, stride, slot), stride);
+
+		if (element.max > wear.max) {
+			wear.max = element.max;
+			wear.address = element.address;
+			wear.slot = slot;
+		}
+		if (element.max < wear.min)
+			wear.min = element.max;
+	}
+	if (wear.min == UINT32_MAX)
+		wear.min = 0;
+	return wear;
+}
+
+static void replay_print_slots(uint32_t base, uint32_t stride, uint32_t slots) {
+	for (uint32_t slot = 0; slot < slots; slot++)
+		printf("%s%5u:%-7u", slot % 8 ? " " : "\n    slot", slot,
+		       replay_cells_wear(EEPROM_RING_ADDRESS(base, stride, slot), stride).max);
+	printf("\n");
+}
+
+// Срок службы при износе wear за период трассы, лет
+static double replay_life(uint32_t wear, double duration) {
+	return wear ? opt.endurance * duration / wear / REPLAY_YEAR : 0.0;
+}
+
+// Износ и срок службы области в отдельной строке отчета
+static void replay_print_region(const char *name, replay_wear_t wear, double duration) {
+	printf("%s: wear %u..%u, ", name, wear.min, wear.max);
+	if (wear.max)
+		printf("life %.1f years\n", replay_life(wear.max, duration));
+	else
+		printf("no wear\n");
+}
+
+// Запоминает ячейку, которая исчерпает ресурс раньше остальных
+static void replay_first(replay_wear_t *first, const char **first_name, int *first_param,
+                         replay_wear_t wear, const char *name, int param) {
+	if (wear.max > first->max) {
+		*first = wear;
+		*first_name = name;
+		*first_param = param;
+	}
+}
+
+#if !EEPROM_USE_LOG
+// Подбор таблицы: количество элементов буфера и байт области приращений счетчика пропорциональны
+// нагрузке (элементо-циклов за секунду) и сроку службы life, с. 0 - таблица не помещается
+static uint32_t replay_layout_end(const double *ring_load, const double *counter_load, double life,
+                                  uint32_t *count, uint32_t *counter) {
+	uint32_t addr = EEPROM_PAGE_ALIGN(EEPROM_START_ADR);
+
+	for (uint8_t index = 0; index < REPLAY_PARAMS; index++) {
+		double need = ring_load[index] * life / opt.endurance;
+		if (need > 65535.0)
+			return 0;
+		count[index] = (uint32_t)need < need ? (uint32_t)need + 1 : (uint32_t)need;
+		if (count[index] < REPLAY_MIN_COUNT)
+			count[index] = REPLAY_MIN_COUNT;
+
+		counter[index] = 0;
+		if (replay_is_counter(index)) {
+			need = counter_load[index] * life / opt.endurance;
+			if (need > 255.0)
+				return 0;
+			counter[index] = (uint32_t)need < need ? (uint32_t)need + 1 : (uint32_t)need;
+			if (counter[index] == 0)
+				counter[index] = 1;
+		}
+
+		uint8_t seq = count[index] > 255 ? 2 : replay_param[index].seq_size;
+		uint32_t stride = replay_param[index].element_size + seq + EEPROM_CRC_SIZE;
+		addr = EEPROM_PAGE_ALIGN(addr);
+#if EEPROM_HAL_PAGE_SIZE
+		if (stride > EEPROM_HAL_PAGE_SIZE)
+			return 0;
+#endif
+		addr += EEPROM_RING_BYTES(stride, count[index]) + 2 * counter[index];
+	}
+	return addr <= EEPROM_START_ADR + opt.budget ? addr : 0;
+}
+
+static void replay_print_layout(const uint32_t *count, const uint32_t *counter) {
+	for (uint8_t index = 0; index < REPLAY_PARAMS; index++) {
+		printf(" %u:%u", index, count[index]);
+		if (replay_is_counter(index))
+			printf("/%u", counter[index]);
+	}
+	printf("\n");
+}
+#endif
+
+static void replay_report(const char *path, double duration, uint32_t cuts, uint32_t torn) {
+	replay_wear_t first = {0, 0, 0, 0};
+	const char *first_name = NULL;
+	int first_param = -1;
+
+	printf("trace %s: %zu writes, period %.0f s, replayed %u times (%.0f s)\n",
+	       path, trace_len, opt.period, opt.repeat, duration);
+	printf("layout %s: EEPROM %u bytes, parameters from %u, %u params, endurance %.0f cycles\n",
+	       EEPROM_LAYOUT_FILE, EEPROM_SIZE, EEPROM_START_ADR, (unsigned)REPLAY_PARAMS, opt.endurance);
+	if (cuts)
+		printf("power cuts: %u, values never written found after remount: %u\n", cuts, torn);
+	if (eeprom_sim_stats()->errors)
+		printf("simulator protocol errors: %u\n", eeprom_sim_stats()->errors);
+
+#if EEPROM_USE_TXN
+	replay_wear_t txn = replay_region_wear(EEPROM_START_ADR - EEPROM_TXN_AREA_SIZE, EEPROM_TXN_ENTRY_SIZE, EEPROM_TXN_SLOTS);
+	replay_print_region("transaction journal", txn, duration);
+	replay_first(&first, &first_name, &first_param, txn, "transaction journal", -1);
+#endif
+
+#if EEPROM_USE_LOG
+	// Все параметры пишут в один журнал: подбирается только его размер
+	uint32_t log_base = EEPROM_PAGE_ALIGN(EEPROM_START_ADR);
+	uint32_t log_slots = EEPROM_RING_SLOTS(EEPROM_SIZE - log_base, EEPROM_LOG_RECORD_SIZE);
+	replay_wear_t log = replay_region_wear(log_base, EEPROM_LOG_RECORD_SIZE, log_slots);
+
+	printf("\n%5s %8s\n", "param", "writes");
+	for (uint8_t index = 0; index < REPLAY_PARAMS; index++)
+		printf("%5u %8u\n", index, param_writes[index]);
+	printf("\n%u records, hottest record %u\n", log_slots, log.slot);
+	replay_print_region("log", log, duration);
+	if (opt.verbose)
+		replay_print_slots(log_base, EEPROM_LOG_RECORD_SIZE, log_slots);
+	replay_first(&first, &first_name, &first_param, log, "log", -1);
+#else
+	double ring_load[REPLAY_PARAMS], counter_load[REPLAY_PARAMS];
+
+	printf("\n%5s %5s %6s %8s %16s %8s %12s\n", "param", "size", "count", "writes", "slot wear", "hottest", "life, years");
+	for (uint8_t index = 0; index < REPLAY_PARAMS; index++) {
+		const param_eeprom_t *param = &replay_param[index];
+		uint32_t stride = param->element_size + param->seq_size + EEPROM_CRC_SIZE;
+		replay_wear_t ring = replay_region_wear(param->addr, stride, param->buffer_count);
+
+		printf("%5u %5u %6u %8u %7u..%-8u %8u", index, param->element_size, param->buffer_count,
+		       param_writes[index], ring.min, ring.max, ring.slot);
+		if (ring.max)
+			printf("%12.1f\n", replay_life(ring.max, duration));
+		else
+			printf("%12s\n", "no wear");
+		if (opt.verbose)
+			replay_print_slots(param->addr, stride, param->buffer_count);
+		ring_load[index] = (double)ring.max * param->buffer_count / duration;
+		replay_first(&first, &first_name, &first_param, ring, "ring", index);
+
+		counter_load[index] = 0.0;
+		if (replay_is_counter(index)) {
+			// Две области приращений за кольцевым буфером изнашиваются по очереди
+			replay_wear_t cnt = replay_cells_wear(param->addr + EEPROM_RING_BYTES(stride, param->buffer_count),
+			                                      2 * param->counter);
+			printf("%5s 2 x %u bytes ", "", param->counter);
+			replay_print_region("counter regions", cnt, duration);
+			counter_load[index] = (double)cnt.max * param->counter / duration;
+			replay_first(&first, &first_name, &first_param, cnt, "counter regions", index);
+		}
+	}
+#endif
+
+	if (first_name == NULL) {
+		printf("\nno cell was erased, lifetime is not limited by this trace\n");
+		return;
+	}
+	printf("\nfirst cell to wear out: address %u (%s", first.address, first_name);
+	if (first_param >= 0)
+		printf(" of param %d", first_param);
+	if (strcmp(first_name, "ring") == 0 || strcmp(first_name, "log") == 0)
+		printf(", slot %u", first.slot);
+	printf("), %u cycles per period, after %.1f years\n", first.max, replay_life(first.max, duration));
+
+	double target = opt.years * REPLAY_YEAR;
+#if EEPROM_USE_LOG
+	// Перенос живых записей вперед добавляет износ, поэтому оценка для короткого журнала занижена
+	double need = (double)log.max * log_slots / duration * target / opt.endurance;
+	uint32_t records = (uint32_t)need < need ? (uint32_t)need + 1 : (uint32_t)need;
+	if (records < REPLAY_PARAMS + 2)
+		records = REPLAY_PARAMS + 2;
+	printf("suggested log for %.1f years: %u records, %u bytes (EEPROM_SIZE %u), budget %u bytes\n",
+	       opt.years, records, EEPROM_RING_BYTES(EEPROM_LOG_RECORD_SIZE, records),
+	       log_base + EEPROM_RING_BYTES(EEPROM_LOG_RECORD_SIZE, records), opt.budget);
+#else
+	uint32_t count[REPLAY_PARAMS], counter[REPLAY_PARAMS];
+	uint32_t end = replay_layout_end(ring_load, counter_load, target, count, counter);
+
+	if (end) {
+		printf("suggested _COUNT (param:count/counter bytes) for %.1f years, %u of %u bytes:",
+		       opt.years, end - EEPROM_START_ADR, opt.budget);
+		replay_print_layout(count, counter);
+	} else {
+		printf("%.1f years do not fit into %u bytes\n", opt.years, opt.budget);
+	}
+
+	// Наибольший срок, при котором подобранная таблица помещается в отведенное место
+	double low = 0.0, high = 1000.0 * REPLAY_YEAR;
+	if (replay_layout_end(ring_load, counter_load, high, count, counter)) {
+		printf("more than 1000 years fit into %u bytes\n", opt.budget);
+	} else if (!replay_layout_end(ring_load, counter_load, 0.0, count, counter)) {
+		printf("the smallest table does not fit into %u bytes\n", opt.budget);
+	} else {
+		for (int i = 0; i < 100; i++) {
+			double middle = (low + high) / 2;
+			if (replay_layout_end(ring_load, counter_load, middle, count, counter))
+				low = middle;
+			else
+				high = middle;
+		}
+		end = replay_layout_end(ring_load, counter_load, low, count, counter);
+		printf("longest life within %u bytes: %.1f years, %u bytes:", opt.budget, low / REPLAY_YEAR, end - EEPROM_START_ADR);
+		replay_print_layout(count, counter);
+	}
+#if EEPROM_USE_TXN
+	if (txn.max)
+		printf("transaction journal limits life to %.1f years (EEPROM_TXN_SLOTS)\n", replay_life(txn.max, duration));
+#endif
+#endif
+}
+
+static void replay_usage(const char *name) {
+	fprintf(stderr,
+	        "usage: %s [options] trace\n"
+	        "  -p seconds   period covered by the trace (default: time of the last write)\n"
+	        "  -n count     replay the trace count times (default 1)\n"
+	        "  -y years     target lifetime for suggested _COUNT values (default 10)\n"
+	        "  -e cycles    cell endurance, erase cycles (default 100000)\n"
+	        "  -b bytes     EEPROM budget for parameters from EEPROM_START_ADR (default EEPROM_SIZE - EEPROM_START_ADR)\n"
+	        "  -c rate      probability of a power cut after each write, 0..1 (default 0)\n"
+	        "  -s seed      random seed for power cuts (default 1)\n"
+	        "  -v           print wear of every slot\n", name);
+}
+
+int main(int argc, char *argv[]) {
+	int c;
+
+	while ((c = getopt(argc, argv, "p:n:y:e:b:c:s:v")) != -1) {
+		switch (c) {
+		case 'p': opt.period = atof(optarg); break;
+		case 'n': opt.repeat = (uint32_t)strtoul(optarg, NULL, 0); break;
+		case 'y': opt.years = atof(optarg); break;
+		case 'e': opt.endurance = atof(optarg); break;
+		case 'b': opt.budget = (uint32_t)strtoul(optarg, NULL, 0); break;
+		case 'c': opt.cut_rate = atof(optarg); break;
+		case 's': opt.seed = strtoull(optarg, NULL, 0); break;
+		case 'v': opt.verbose = 1; break;
+		default:
+			replay_usage(argv[0]);
+			return 1;
+		}
+	}
+	if (optind != argc - 1 || opt.repeat == 0 || opt.endurance <= 0.0 || opt.years <= 0.0) {
+		replay_usage(argv[0]);
+		return 1;
+	}
+	if (replay_load(argv[optind]) != 0)
+		return 1;
+	if (opt.period == 0.0 && trace_len)
+		opt.period = trace[trace_len - 1].time;
+	if (opt.period <= 0.0 || (trace_len && trace[trace_len - 1].time > opt.period)) {
+		fprintf(stderr, "the trace needs a period (-p) covering all writes\n");
+		return 1;
+	}
+	replay_rand_state = opt.seed;
+
+	if (eeprom_sim_init(NULL, EEPROM_SIZE) != 0) {
+		fprintf(stderr, "eeprom_sim_init failed\n");
+		return 1;
+	}
+	EEPROM_Mount();
+	EEPROM_PreErase();
+	replay_remember_current();
+
+	uint32_t cuts = 0, torn = 0;
+	for (uint32_t round = 0; round < opt.repeat; round++) {
+		for (size_t i = 0; i < trace_len; i++) {
+			const replay_entry_t *entry = &trace[i];
+			uint8_t data[256];
+
+			replay_run_to((uint64_t)((round * opt.period + entry->time) * 1e9));
+			param_writes[entry->index]++;
+			if (replay_is_counter(entry->index)) {
+#if EEPROM_USE_COUNTER
+				EEPROM_AddCounter(entry->index, (uint16_t)entry->value);
+#endif
+			} else {
+				replay_value(entry->index, entry->value, data);
+				replay_remember(replay_hash(entry->index, data, replay_param[entry->index].element_size));
+				EEPROM_WriteWearLeveled(entry->index, data);
+			}
+#if !EEPROM_USE_SHADOW
+			EEPROM_Flush();
+#endif
+			if (opt.cut_rate > 0.0 && replay_rand() < opt.cut_rate * 2147483648.0) {
+				torn += replay_power_cut();
+				EEPROM_PreErase();
+				cuts++;
+			}
+		}
+	}
+	replay_run_to((uint64_t)(opt.repeat * opt.period * 1e9));
+#if EEPROM_USE_GOVERNOR
+	// Выключение в конце трассы: значения, ожидающие бюджета записи, тоже записываются
+	EEPROM_ForceFlush();
+#else
+	EEPROM_Flush();
+#endif
+	eeprom_sim_run_until_idle();
+
+	replay_report(argv[optind], opt.repeat * opt.period, cuts, torn);
+
+	// Без восстановления (EEPROM_RECOVERY) испорченные сбросом значения ожидаемы и только выводятся
+	if (eeprom_sim_stats()->errors)
+		return 1;
+	return (EEPROM_RECOVERY || EEPROM_USE_LOG) && torn ? 2 : 0;
+}
@@ -0,0 +1,288 @@
+/*
+ * eeprom_sim.c
+ *
+ *  Author: https://github.com/AntonNeutron/EEPROM_WearLeveling
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "eeprom_hal.h"
+#include "eeprom_sim.h"
+
+static struct {
+	uint8_t *mem;
+	uint32_t *wear;       // Циклов стирания каждой ячейки
+	uint32_t size;
+	FILE *file;
+	uint64_t busy_until;  // Момент окончания текущего программирования
+	uint16_t busy_address; // Адрес программируемого байта
+	uint8_t busy_size;    // Количество программируемых байт
+	uint8_t irq_enabled;  // Разрешено прерывание готовности (EERIE)
+	uint8_t atomic;       // Глубина вложенности критических секций
+	uint8_t in_isr;       // Выполняется обработчик прерывания
+	uint8_t preempt;      // Режим вытеснения (eeprom_sim_preempt())
+	eeprom_sim_stats_t stats;
+} sim;
+
+int eeprom_sim_init(const char *path, uint32_t size) {
+	eeprom_sim_close();
+	free(sim.mem);
+	free(sim.wear);
+	memset(&sim, 0, sizeof(sim));
+
+	sim.size = size;
+	sim.mem = malloc(size);
+	sim.wear = calloc(size, sizeof(sim.wear[0]));
+	if (sim.mem == NULL || sim.wear == NULL)
+		return -1;
+	memset(sim.mem, 0xFF, size);
+
+	if (path != NULL) {
+		sim.file = fopen(path, "r+b");
+		if (sim.file != NULL) {
+			size_t loaded = fread(sim.mem, 1, size, sim.file);
+			(void)loaded;  // Короткий файл дополняется стертыми ячейками
+		} else {
+			sim.file = fopen(path, "w+b");
+			if (sim.file == NULL)
+				return -1;
+		}
+		fseek(sim.file, 0, SEEK_SET);
+		fwrite(sim.mem, 1, size, sim.file);
+		fflush(sim.file);
+	}
+	return 0;
+}
+
+void eeprom_sim_close(void) {
+	if (sim.file != NULL) {
+		fclose(sim.file);
+		sim.file = NULL;
+	}
+}
+
+uint8_t *eeprom_sim_memory(void) {
+	return sim.mem;
+}
+
+uint32_t *eeprom_sim_wear(void) {
+	return sim.wear;
+}
+
+int32_t eeprom_sim_programming(void) {
+	return sim.busy_until > sim.stats.time_ns ? sim.busy_address : -1;
+}
+
+uint8_t eeprom_sim_programming_size(void) {
+	return sim.busy_until > sim.stats.time_ns ? sim.busy_size : 0;
+}
+
+const eeprom_sim_stats_t *eeprom_sim_stats(void) {
+	return &sim.stats;
+}
+
+// Вызов обработчика прерывания готовности, не вложенный в другой
+static void eeprom_sim_isr(void) {
+	sim.in_isr = 1;
+	sim.stats.isr_calls++;
+	eeprom_hal_ready_isr();
+	sim.in_isr = 0;
+}
+
+// Точка вытеснения: в режиме вытеснения прерывание готовности приходит посреди вызова API, как
+// только оно разрешено и программирование закончено (время продвигается до его окончания)
+static void eeprom_sim_preempt_point(void) {
+	if (!sim.preempt || sim.atomic || sim.in_isr || !sim.irq_enabled)
+		return;
+	if (sim.busy_until > sim.stats.time_ns)
+		sim.stats.time_ns = sim.busy_until;
+	sim.stats.preemptions++;
+	eeprom_sim_isr();
+}
+
+void eeprom_sim_preempt(uint8_t enable) {
+	sim.preempt = enable;
+}
+
+void eeprom_hal_atomic_enter(void) {
+	sim.atomic++;
+}
+
+// Отложенное в критической секции прерывание приходит сразу после выхода из нее
+void eeprom_hal_atomic_leave(const uint8_t *once) {
+	(void)once;
+	if (--sim.atomic == 0)
+		eeprom_sim_preempt_point();
+}
+
+// Чтение при идущем программировании ждет его окончания (как eeprom_read_byte в avr-libc)
+static void eeprom_sim_wait_ready(void) {
+	if (sim.busy_until > sim.stats.time_ns) {
+		sim.stats.stalls++;
+		sim.stats.stall_ns += sim.busy_until - sim.stats.time_ns;
+		sim.stats.time_ns = sim.busy_until;
+	}
+}
+
+uint8_t eeprom_hal_read_byte(uint16_t address) {
+	eeprom_sim_preempt_point();
+	eeprom_sim_wait_ready();
+	sim.stats.time_ns += EEPROM_SIM_READ_NS;
+	sim.stats.reads++;
+	if (address >= sim.size) {
+		sim.stats.errors++;
+		return 0xFF;
+	}
+	return sim.mem[address];
+}
+
+void eeprom_hal_read_block(void *dst, uint16_t address, uint8_t size) {
+	for (uint8_t i = 0; i < size; i++)
+		((uint8_t *)dst)[i] = eeprom_hal_read_byte(address + i);
+}
+
+#if EEPROM_HAL_PAGE_SIZE
+// Запись страницы: адресный счетчик 24Cxx/25xx перебирает байты внутри страницы, поэтому
+// запись через границу страницы портит ее начало - такая запись считается ошибкой
+void eeprom_hal_program_page(uint16_t address, const uint8_t *data, uint8_t size) {
+	if (sim.busy_until > sim.stats.time_ns || size == 0 || size > EEPROM_HAL_PAGE_SIZE
+	    || address / EEPROM_HAL_PAGE_SIZE != (address + size - 1U) / EEPROM_HAL_PAGE_SIZE
+	    || address + (uint32_t)size > sim.size) {
+		sim.stats.errors++;
+		if (size == 0 || address + (uint32_t)size > sim.size)
+			return;
+	}
+
+	memcpy(&sim.mem[address], data, size);
+	for (uint8_t i = 0; i < size; i++)
+		sim.wear[address + i]++;
+	sim.stats.pages++;
+	sim.stats.programs += size;
+	sim.busy_until = sim.stats.time_ns + EEPROM_SIM_PAGE_NS;
+	sim.busy_address = address;
+	sim.busy_size = size;
+
+	if (sim.file != NULL) {
+		fseek(sim.file, address, SEEK_SET);
+		fwrite(&sim.mem[address], 1, size, sim.file);
+		fflush(sim.file);
+	}
+}
+
+// Блокирующая запись байта командой записи страницы
+void eeprom_hal_write_byte(uint16_t address, uint8_t data) {
+	if (eeprom_hal_read_byte(address) != data)
+		eeprom_hal_program_page(address, &data, 1);
+}
+#else
+void eeprom_hal_program_byte(uint16_t address, uint8_t data, uint8_t mode) {
+	if (sim.busy_until > sim.stats.time_ns || address >= sim.size) {
+		sim.stats.errors++;
+		if (address >= sim.size)
+			return;
+	}
+
+	uint64_t duration;
+	switch (mode) {
+	case EEPROM_HAL_ERASE_ONLY:
+		sim.mem[address] = 0xFF;
+		sim.wear[address]++;
+		duration = EEPROM_SIM_ERASE_NS;
+		sim.stats.erases++;
+		break;
+	case EEPROM_HAL_WRITE_ONLY:
+		sim.mem[address] &= data;
+		duration = EEPROM_SIM_WRITE_NS;
+		sim.stats.writes++;
+		break;
+	default:
+		sim.mem[address] = data;
+		sim.wear[address]++;
+		duration = EEPROM_SIM_ERASE_WRITE_NS;
+		sim.stats.erase_writes++;
+		break;
+	}
+	sim.stats.programs++;
+	sim.busy_until = sim.stats.time_ns + duration;
+	sim.busy_address = address;
+	sim.busy_size = 1;
+
+	if (sim.file != NULL) {
+		fseek(sim.file, address, SEEK_SET);
+		fputc(sim.mem[address], sim.file);
+		fflush(sim.file);
+	}
+}
+
+// Блокирующая запись, как eeprom_update_byte в avr-libc: ждет готовности, совпадающий байт не пишет
+void eeprom_hal_write_byte(uint16_t address, uint8_t data) {
+	if (eeprom_hal_read_byte(address) != data)
+		eeprom_hal_program_byte(address, data, EEPROM_HAL_ERASE_WRITE);
+}
+#endif
+
+// Опрос готовности занимает время: цикл опроса (аварийная запись) дожидается окончания программирования
+uint8_t eeprom_hal_busy(void) {
+	eeprom_sim_preempt_point();
+	if (sim.busy_until <= sim.stats.time_ns)
+		return 0;
+	sim.stats.time_ns += EEPROM_SIM_READ_NS;
+	return 1;
+}
+
+// Ожидание готовности перед чтением считается остановкой, как и чтение при идущем программировании
+void eeprom_hal_wait_ready(void) {
+	eeprom_sim_wait_ready();
+}
+
+void eeprom_hal_ready_irq(uint8_t enable) {
+	sim.irq_enabled = enable;
+	eeprom_sim_preempt_point();
+}
+
+uint8_t eeprom_hal_ready_irq_enabled(void) {
+	return sim.irq_enabled;
+}
+
+// Такты МК по симулированному времени: растут только на чтениях EEPROM и ожидании ее готовности
+uint16_t eeprom_hal_cycles(void) {
+	return (uint16_t)(sim.stats.time_ns * EEPROM_SIM_CPU_MHZ / 1000);
+}
+
+void eeprom_sim_run(uint64_t ns) {
+	uint64_t end = sim.stats.time_ns + ns;
+
+	// Прерывание готовности срабатывает, пока оно разрешено и EEPROM свободна
+	while (sim.irq_enabled && sim.busy_until <= end) {
+		if (sim.busy_until > sim.stats.time_ns)
+			sim.stats.time_ns = sim.busy_until;
+
+		uint64_t busy_until = sim.busy_until;
+		eeprom_sim_isr();
+
+		// Обработчик не начал запись и не запретил прерывание - на МК оно вызывалось бы бесконечно
+		if (sim.irq_enabled && sim.busy_until == busy_until) {
+			sim.stats.errors++;
+			break;
+		}
+	}
+	if (end > sim.stats.time_ns)
+		sim.stats.time_ns = end;
+}
+
+uint64_t eeprom_sim_run_until_idle(void) {
+	uint64_t start = sim.stats.time_ns;
+
+	while (sim.irq_enabled) {
+		uint32_t errors = sim.stats.errors;
+
+		eeprom_sim_run(sim.busy_until > sim.stats.time_ns ? sim.busy_until - sim.stats.time_ns : 0);
+		if (sim.stats.errors != errors)
+			break;
+	}
+	// Дожидаемся окончания программирования последнего байта
+	if (sim.busy_until > sim.stats.time_ns)
+		sim.stats.time_ns = sim.busy_until;
+	return sim.stats.time_ns - start;
+}
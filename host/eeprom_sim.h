@@ -0,0 +1,113 @@
+/*
+ * eeprom_sim.h
+ *
+ *  Author: https://github.com/AntonNeutron/EEPROM_WearLeveling
+ */
+
+/*
+  Симулятор встроенной EEPROM AVR для сборки библиотеки на хосте (Linux).
+
+  Реализует функции eeprom_hal_* из eeprom_hal.h. Содержимое EEPROM хранится
+  в памяти и, при необходимости, в файле. Время моделируется: чтение байта
+  занимает EEPROM_SIM_READ_NS, программирование байта - от 1.8 до 3.4 мс в
+  зависимости от режима. Прерывание готовности EEPROM вызывается таймером
+  симулятора внутри eeprom_sim_run(), т.е. только между вызовами API библиотеки.
+  В режиме вытеснения (eeprom_sim_preempt()) оно приходит и посреди вызова API: при
+  каждом чтении EEPROM, опросе готовности, разрешении прерывания и выходе из критической
+  секции EEPROM_HAL_ATOMIC_BLOCK() - так на хосте проверяется работа с общими данными.
+
+  С -DEEPROM_HAL_PAGE_SIZE симулируется внешняя EEPROM со страничной записью
+  (24Cxx/25xx): запись до EEPROM_HAL_PAGE_SIZE байт в пределах одной страницы
+  занимает EEPROM_SIM_PAGE_NS, запись через границу страницы - ошибка протокола.
+
+  Износ считается по ячейкам в циклах стирания: стирание + запись и только стирание
+  добавляют цикл, запись без стирания (сброс битов) - нет. Запись страницы внешней
+  EEPROM добавляет цикл каждому записанному байту (микросхема стирает их перед записью).
+*/
+
+#ifndef EEPROM_SIM_H_
+#define EEPROM_SIM_H_
+
+#include <stdint.h>
+
+// Время чтения байта (4 такта при 16 МГц), нс
+#ifndef EEPROM_SIM_READ_NS
+#define EEPROM_SIM_READ_NS 250ULL
+#endif
+
+// Тактовая частота МК для счетчика тактов eeprom_hal_cycles(), МГц
+#ifndef EEPROM_SIM_CPU_MHZ
+#define EEPROM_SIM_CPU_MHZ 16
+#endif
+
+// Время программирования байта: стирание + запись, только запись, только стирание, нс
+#ifndef EEPROM_SIM_ERASE_WRITE_NS
+#define EEPROM_SIM_ERASE_WRITE_NS 3400000ULL
+#endif
+#ifndef EEPROM_SIM_WRITE_NS
+#define EEPROM_SIM_WRITE_NS 1800000ULL
+#endif
+#ifndef EEPROM_SIM_ERASE_NS
+#define EEPROM_SIM_ERASE_NS 1800000ULL
+#endif
+
+// Время записи страницы внешней EEPROM (tWR), нс
+#ifndef EEPROM_SIM_PAGE_NS
+#define EEPROM_SIM_PAGE_NS 5000000ULL
+#endif
+
+// Счетчики симулятора
+typedef struct {
+	uint64_t time_ns;       // Симулированное время
+	uint32_t reads;         // Прочитано байт
+	uint32_t programs;      // Запрограммировано байт, всего
+	uint32_t erase_writes;  // из них в режиме стирание + запись
+	uint32_t writes;        // только запись
+	uint32_t erases;        // только стирание
+	uint32_t pages;         // Команд записи страницы внешней EEPROM
+	uint32_t isr_calls;     // Вызовов обработчика прерывания готовности
+	uint32_t preemptions;   // из них посреди вызова API (режим вытеснения)
+	uint32_t stalls;        // Чтений, ожидавших окончания программирования
+	uint64_t stall_ns;      // Суммарное время этого ожидания
+	uint32_t errors;        // Нарушения протокола (выход за границы, запись при занятой EEPROM и т.п.)
+} eeprom_sim_stats_t;
+
+/**
+ * @brief Инициализирует симулятор.
+ *
+ * @param path Файл с содержимым EEPROM (создается стертым, если его нет),
+ *             NULL - EEPROM только в памяти.
+ * @param size Объем EEPROM в байтах (не более 65536).
+ * @return 0 при успехе, -1 при ошибке работы с файлом.
+ */
+int eeprom_sim_init(const char *path, uint32_t size);
+
+// Закрывает файл EEPROM
+void eeprom_sim_close(void);
+
+// Содержимое EEPROM для прямого доступа из тестов и утилит
+uint8_t *eeprom_sim_memory(void);
+
+// Циклы стирания каждой ячейки с момента eeprom_sim_init() (файл EEPROM износ не хранит)
+uint32_t *eeprom_sim_wear(void);
+
+// Продвигает симулированное время на ns, вызывая обработчик прерывания готовности по пути
+void eeprom_sim_run(uint64_t ns);
+
+// Выполняет все отложенные записи (пока прерывание готовности разрешено). Возвращает затраченное время, нс
+uint64_t eeprom_sim_run_until_idle(void);
+
+// Режим вытеснения: прерывание готовности вызывается в точках обращения к HAL вне критических секций,
+// как только оно разрешено (программирование при этом заканчивается сразу)
+void eeprom_sim_preempt(uint8_t enable);
+
+// Адрес байта, который программируется в данный момент, или -1, если EEPROM свободна
+int32_t eeprom_sim_programming(void);
+
+// Количество программируемых байт начиная с eeprom_sim_programming() (больше 1 при записи страницы)
+uint8_t eeprom_sim_programming_size(void);
+
+// Текущие счетчики
+const eeprom_sim_stats_t *eeprom_sim_stats(void);
+
+#endif /* EEPROM_SIM_H_ */
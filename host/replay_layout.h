@@ -0,0 +1,45 @@
+/*
+ * replay_layout.h
+ *
+ *  Author: https://github.com/AntonNeutron/EEPROM_WearLeveling
+ */
+
+/*
+  Таблица параметров для eeprom_replay по умолчанию - копия таблицы из eeprom.c.
+  Для проверки своей таблицы скопируйте ее enum и param_eeprom в отдельный файл
+  и соберите утилиту с ним: make replay LAYOUT=my_layout.h.
+  С транзакциями (EEPROM_USE_TXN) журнал транзакций помещается перед EEPROM_START_ADR.
+*/
+
+enum {
+	EEPROM_SIZE = 4000,
+	EEPROM_START_ADR = EEPROM_PAGE_ALIGN(100),
+
+	EE_LCD_LIGHT_SIZE = sizeof(uint8_t),
+	EE_LCD_LIGHT_SEQ = 1,
+	EE_LCD_LIGHT_COUNT = 5,
+	EE_LCD_LIGHT_QUIET = 10,
+	EE_LCD_LIGHT_COUNTER = 0,
+	EE_LCD_LIGHT_PRIORITY = 0,
+	EE_LCD_LIGHT_ADDR = EEPROM_PAGE_ALIGN(EEPROM_START_ADR),
+	EE_LCD_LIGHT_END = EE_LCD_LIGHT_ADDR + EEPROM_RING_BYTES(EE_LCD_LIGHT_SIZE + EE_LCD_LIGHT_SEQ + EEPROM_CRC_SIZE, EE_LCD_LIGHT_COUNT) + 2 * EE_LCD_LIGHT_COUNTER,
+
+	EE_BAT_MIN_V_SIZE = sizeof(uint16_t),
+	EE_BAT_MIN_V_SEQ = 1,
+	EE_BAT_MIN_V_COUNT = 3,
+	EE_BAT_MIN_V_QUIET = 10,
+	EE_BAT_MIN_V_COUNTER = 0,
+	EE_BAT_MIN_V_PRIORITY = 0,
+	EE_BAT_MIN_V_ADDR = EEPROM_PAGE_ALIGN(EE_LCD_LIGHT_END),
+	EE_BAT_MIN_V_END = EE_BAT_MIN_V_ADDR + EEPROM_RING_BYTES(EE_BAT_MIN_V_SIZE + EE_BAT_MIN_V_SEQ + EEPROM_CRC_SIZE, EE_BAT_MIN_V_COUNT) + 2 * EE_BAT_MIN_V_COUNTER,
+
+	EEPROM_DATA_SIZE = EE_LCD_LIGHT_SIZE + EE_BAT_MIN_V_SIZE,
+};
+
+extern uint8_t error_eeprom_overflow[EE_BAT_MIN_V_END > EEPROM_SIZE ? -1 : 0];
+extern uint8_t error_eeprom_log_value[(EEPROM_USE_LOG && (EE_LCD_LIGHT_SIZE > EEPROM_LOG_VALUE_SIZE || EE_BAT_MIN_V_SIZE > EEPROM_LOG_VALUE_SIZE)) ? -1 : 0];
+
+const param_eeprom_t param_eeprom[] PROGMEM = {
+	{EE_LCD_LIGHT_SIZE, EE_LCD_LIGHT_SEQ, EE_LCD_LIGHT_COUNT, EE_LCD_LIGHT_ADDR, EE_LCD_LIGHT_QUIET, EE_LCD_LIGHT_COUNTER, EE_LCD_LIGHT_PRIORITY},
+	{EE_BAT_MIN_V_SIZE, EE_BAT_MIN_V_SEQ, EE_BAT_MIN_V_COUNT, EE_BAT_MIN_V_ADDR, EE_BAT_MIN_V_QUIET, EE_BAT_MIN_V_COUNTER, EE_BAT_MIN_V_PRIORITY},
+};